@@ -1,11 +1,15 @@
 #pragma once
 
 #include <slugkit/geo/lookup/maxmind_db_lookup.hpp>
+#include <slugkit/geo/lookup/maxmind_snapshot_registry.hpp>
 
 #include <userver/server/handlers/http_handler_base.hpp>
 
 namespace slugkit::geo::endpoints {
 
+/// @brief Handler for reloading MaxMind databases.
+/// Reloads all the files of the maxmind-snapshot-registry if it is configured, and the maxmind-db-lookup.
+/// The latter is a no-op if it shares its file via the registry. At least one of them must be configured.
 class ReloadMaxmindDb : public userver::server::handlers::HttpHandlerBase {
 public:
     static constexpr std::string_view kName = "handler-reload-maxmind-db";
@@ -24,7 +28,8 @@ private:
     auto Reload() const -> void;
 
 private:
-    lookup::MaxmindDb& maxmind_db_lookup_;
+    lookup::MaxmindSnapshotRegistry* snapshot_registry_;
+    lookup::MaxmindDb* maxmind_db_lookup_;
 };
 
 }  // namespace slugkit::geo::endpoints
\ No newline at end of file
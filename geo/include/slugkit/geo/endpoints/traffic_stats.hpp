@@ -0,0 +1,30 @@
+#pragma once
+
+#include <slugkit/geo/traffic_stats.hpp>
+
+#include <userver/server/handlers/http_handler_json_base.hpp>
+
+namespace slugkit::geo::endpoints {
+
+/// @brief Admin handler returning the merged geo traffic statistics
+/// Includes the heavy hitter prefixes, which are not exported to the metrics
+class TrafficStatsHandler : public userver::server::handlers::HttpHandlerJsonBase {
+public:
+    static constexpr std::string_view kName = "handler-geo-traffic-stats";
+
+    TrafficStatsHandler(
+        const userver::components::ComponentConfig& config,
+        const userver::components::ComponentContext& context
+    );
+
+    auto HandleRequestJsonThrow(
+        const userver::server::http::HttpRequest& request,
+        const userver::formats::json::Value& request_json,
+        userver::server::request::RequestContext& context
+    ) const -> userver::formats::json::Value override;
+
+private:
+    const TrafficStats& traffic_stats_;
+};
+
+}  // namespace slugkit::geo::endpoints
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace slugkit::geo {
+
+/// Size of the ::ffff:0:0/96 prefix of the IPv4-mapped IPv6 addresses, the IPv4 address follows it
+constexpr std::size_t kIpv4MappedPrefixSize = 12;
+
+/// @brief IP address in binary form, IPv4 is stored as IPv4-mapped IPv6 address (::ffff:a.b.c.d).
+struct IpAddress {
+    std::array<std::uint8_t, 16> bytes{};
+    bool is_v4{false};
+};
+
+/// Parses a textual IPv4 or IPv6 address without DNS resolution, std::nullopt if it is not an address
+auto ParseIpAddress(const std::string& ip) -> std::optional<IpAddress>;
+
+auto IsIpv4Mapped(const std::array<std::uint8_t, 16>& bytes) -> bool;
+
+/// splitmix64 finaliser, spreads the bits of a key over the whole word. Stable across processes.
+constexpr auto MixHash(std::uint64_t value) -> std::uint64_t {
+    value ^= value >> 30;
+    value *= 0xbf58476d1ce4e5b9ULL;
+    value ^= value >> 27;
+    value *= 0x94d049bb133111ebULL;
+    value ^= value >> 31;
+    return value;
+}
+
+/// Hash of the 16 bytes of an address or a network prefix. Stable across processes.
+inline auto HashAddressBytes(const std::array<std::uint8_t, 16>& bytes) -> std::uint64_t {
+    std::uint64_t high = 0;
+    std::uint64_t low = 0;
+    std::memcpy(&high, bytes.data(), sizeof(high));
+    std::memcpy(&low, bytes.data() + sizeof(high), sizeof(low));
+    return MixHash(high ^ MixHash(low));
+}
+
+/// FNV-1a of the bytes, e.g. of a name that must hash the same in every process. Stable across processes.
+constexpr auto HashString(std::string_view data) -> std::uint64_t {
+    std::uint64_t hash = 14695981039346656037ULL;
+    for (auto c : data) {
+        hash ^= static_cast<std::uint8_t>(c);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+}  // namespace slugkit::geo
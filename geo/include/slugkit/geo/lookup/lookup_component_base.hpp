@@ -4,6 +4,10 @@
 
 #include <userver/components/component_base.hpp>
 
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
 namespace slugkit::geo::lookup {
 
 class ComponentBase : public userver::components::ComponentBase {
@@ -17,6 +21,36 @@ public:
 
     // TODO Add lookup deadline
     [[nodiscard]] virtual auto Lookup(const std::string& ip) const -> std::optional<LookupResult> = 0;
+
+    /// @brief Lookup with names in the given language.
+    /// Resolvers that don't support the language (or any languages at all) fall back to their default.
+    [[nodiscard]] virtual auto LookupLocalized(const std::string& ip, [[maybe_unused]] std::string_view language) const
+        -> std::optional<LookupResult> {
+        return Lookup(ip);
+    }
+
+    /// @brief Languages the resolver can return names in, the default one first.
+    /// Empty if the resolver doesn't support name localisation.
+    [[nodiscard]] virtual auto GetLanguages() const -> std::vector<std::string> {
+        return {};
+    }
+
+    /// @brief False while the resolver is still loading its data, lookups are skipped until then.
+    [[nodiscard]] virtual auto IsReady() const -> bool {
+        return true;
+    }
+
+    /// @brief Version of the data the results come from, e.g. the database build time.
+    /// Grows when newer data is loaded, 0 if unknown or not loaded yet. Used to invalidate cached results.
+    [[nodiscard]] virtual auto GetDataVersion() const -> std::uint64_t {
+        return 0;
+    }
+
+    /// @brief Stable hash of the kind of the data, e.g. of the MaxMind database type (GeoIP2-City, GeoLite2-ASN).
+    /// Editions may share a version, shared caches use this to never mix their results. 0 if unknown.
+    [[nodiscard]] virtual auto GetDataSource() const -> std::uint64_t {
+        return 0;
+    }
 };
 
-}  // namespace slugkit::geo::lookup
\ No newline at end of file
+}  // namespace slugkit::geo::lookup
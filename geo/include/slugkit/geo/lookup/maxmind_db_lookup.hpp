@@ -14,11 +14,19 @@ public:
 
     auto Reload() -> void;
     [[nodiscard]] auto Lookup(const std::string& ip_str) const -> std::optional<LookupResult> override;
+    [[nodiscard]] auto LookupLocalized(const std::string& ip_str, std::string_view language) const
+        -> std::optional<LookupResult> override;
+    [[nodiscard]] auto GetLanguages() const -> std::vector<std::string> override;
+    [[nodiscard]] auto IsReady() const -> bool override;
+    [[nodiscard]] auto GetDataVersion() const -> std::uint64_t override;
+    [[nodiscard]] auto GetDataSource() const -> std::uint64_t override;
+
+    auto GetComponentHealth() const -> userver::components::ComponentHealth override;
 
     static auto GetStaticConfigSchema() -> userver::yaml_config::Schema;
 
 private:
-    constexpr static auto kImplSize = 496UL;
+    constexpr static auto kImplSize = 2048UL;
     constexpr static auto kImplAlign = 8UL;
     struct Impl;
     userver::utils::FastPimpl<Impl, kImplSize, kImplAlign> impl_;
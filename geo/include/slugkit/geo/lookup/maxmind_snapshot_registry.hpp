@@ -0,0 +1,41 @@
+#pragma once
+
+#include <userver/components/component_base.hpp>
+#include <userver/utils/fast_pimpl.hpp>
+
+#include <memory>
+#include <string>
+
+namespace slugkit::geo::lookup {
+
+class MaxmindFile;
+
+/// @brief Process-wide registry of MaxMind database files.
+/// All MaxmindDb components referring to the same file (by canonical path) share a single mapping,
+/// and the file is reloaded once for all of them, only when its identity (inode, mtime) changed.
+class MaxmindSnapshotRegistry : public userver::components::ComponentBase {
+public:
+    static constexpr std::string_view kName = "maxmind-snapshot-registry";
+
+    MaxmindSnapshotRegistry(
+        const userver::components::ComponentConfig& config,
+        const userver::components::ComponentContext& context
+    );
+    ~MaxmindSnapshotRegistry() override;
+
+    /// Shared file for the path, registered on first use. Doesn't load it.
+    [[nodiscard]] auto Acquire(const std::string& path) -> std::shared_ptr<MaxmindFile>;
+
+    /// Reloads every registered file that changed on disk, on the fs task processor
+    auto Reload() -> void;
+
+    static auto GetStaticConfigSchema() -> userver::yaml_config::Schema;
+
+private:
+    constexpr static auto kImplSize = 256UL;
+    constexpr static auto kImplAlign = 8UL;
+    struct Impl;
+    userver::utils::FastPimpl<Impl, kImplSize, kImplAlign> impl_;
+};
+
+}  // namespace slugkit::geo::lookup
@@ -3,6 +3,7 @@
 #include <userver/formats/parse/to.hpp>
 #include <userver/formats/serialize/to.hpp>
 
+#include <cstdint>
 #include <optional>
 #include <string>
 
@@ -19,6 +20,7 @@ struct LookupResult {
     std::optional<std::string> city_name;    // English city name
     std::optional<std::string> time_zone;    // Time zone
     std::optional<Coordinates> coordinates;  // Latitude and longitude
+    std::optional<std::uint32_t> asn;        // Autonomous system number
 };
 
 template <typename Format>
@@ -48,6 +50,9 @@ auto Serialize(const LookupResult& lookup_result, userver::formats::serialize::T
     if (lookup_result.coordinates) {
         builder["coordinates"] = lookup_result.coordinates.value();
     }
+    if (lookup_result.asn) {
+        builder["asn"] = lookup_result.asn.value();
+    }
     return builder.ExtractValue();
 }
 
@@ -65,6 +70,9 @@ auto Parse(const Value& value, userver::formats::parse::To<LookupResult>) -> Loo
     if (value.HasMember("coordinates")) {
         lookup_result.coordinates = value["coordinates"].template As<std::optional<Coordinates>>();
     }
+    if (value.HasMember("asn")) {
+        lookup_result.asn = value["asn"].template As<std::optional<std::uint32_t>>();
+    }
     return lookup_result;
 }
 
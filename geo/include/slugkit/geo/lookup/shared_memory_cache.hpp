@@ -0,0 +1,41 @@
+#pragma once
+
+#include <slugkit/geo/lookup/lookup_component_base.hpp>
+
+#include <userver/utils/fast_pimpl.hpp>
+
+namespace slugkit::geo::lookup {
+
+/// @brief Lookup results cache shared by all the processes on the host.
+/// Keeps results of the upstream resolvers in a named POSIX shared memory segment, so that processes
+/// running side by side resolve every hot IP once, and a freshly started process gets hits right away.
+/// Entries are tagged with the upstream data version and kind (e.g. the MaxMind database build epoch and type)
+/// and are ignored once the data is reloaded. Until its own data is loaded, a process serves the entries of
+/// the data loaded last by any process on the host.
+class SharedMemoryCache : public ComponentBase {
+public:
+    static constexpr std::string_view kName = "shared-memory-cache-lookup";
+
+    SharedMemoryCache(
+        const userver::components::ComponentConfig& config,
+        const userver::components::ComponentContext& context
+    );
+    ~SharedMemoryCache() override;
+
+    [[nodiscard]] auto Lookup(const std::string& ip) const -> std::optional<LookupResult> override;
+    [[nodiscard]] auto LookupLocalized(const std::string& ip, std::string_view language) const
+        -> std::optional<LookupResult> override;
+    [[nodiscard]] auto GetLanguages() const -> std::vector<std::string> override;
+    [[nodiscard]] auto IsReady() const -> bool override;
+    [[nodiscard]] auto GetDataVersion() const -> std::uint64_t override;
+
+    static auto GetStaticConfigSchema() -> userver::yaml_config::Schema;
+
+private:
+    constexpr static auto kImplSize = 128UL;
+    constexpr static auto kImplAlign = 8UL;
+    struct Impl;
+    userver::utils::FastPimpl<Impl, kImplSize, kImplAlign> impl_;
+};
+
+}  // namespace slugkit::geo::lookup
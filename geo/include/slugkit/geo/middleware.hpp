@@ -38,7 +38,7 @@ public:
     static auto GetStaticConfigSchema() -> userver::yaml_config::Schema;
 
 private:
-    constexpr static auto kImplSize = 96UL;
+    constexpr static auto kImplSize = 136UL;
     constexpr static auto kImplAlign = 8UL;
     struct Impl;
     userver::utils::FastPimpl<Impl, kImplSize, kImplAlign> impl_;
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <slugkit/geo/ip_address.hpp>
+
+#include <userver/engine/mutex.hpp>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace slugkit::geo {
+
+/// @brief Network prefix the traffic is aggregated by: /24 for IPv4, /48 for IPv6.
+struct NetworkPrefix {
+    std::array<std::uint8_t, 16> bytes{};
+
+    static auto FromAddress(const IpAddress& address) -> NetworkPrefix;
+
+    [[nodiscard]] auto IsV4() const -> bool;
+    /// The first address of the network
+    [[nodiscard]] auto ToAddress() const -> IpAddress;
+    /// CIDR notation, e.g. 192.0.2.0/24 or 2001:db8:1::/48
+    [[nodiscard]] auto ToString() const -> std::string;
+
+    auto operator==(const NetworkPrefix& other) const -> bool = default;
+};
+
+struct NetworkPrefixHash {
+    auto operator()(const NetworkPrefix& prefix) const noexcept -> std::size_t;
+};
+
+struct PrefixCount {
+    NetworkPrefix prefix;
+    std::uint32_t count;
+};
+
+/// @brief Approximate top-k of the most frequent network prefixes.
+/// Count-min sketch of relaxed atomic counters plus a small table of candidates. Recording never blocks and
+/// only touches the table to admit a new candidate: hits on the candidates are counted by the sketch alone,
+/// their counts are read from it by GetTop() and refreshed before one of them is evicted.
+class PrefixSketch {
+public:
+    explicit PrefixSketch(std::size_t capacity);
+
+    auto Record(const NetworkPrefix& prefix) -> void;
+
+    /// Candidates with their current estimates, the most frequent first
+    [[nodiscard]] auto GetTop() const -> std::vector<PrefixCount>;
+
+    /// Adds prefixes with known counts, e.g. a persisted hot set
+    auto Merge(const std::vector<PrefixCount>& prefixes) -> void;
+
+    /// Halves all the counters, so that the old traffic fades out
+    auto Decay() -> void;
+
+private:
+    static constexpr std::size_t kDepth = 4;
+    static constexpr std::size_t kWidth = 4096;
+
+    // Candidates ordered by their count at admission or at the last refresh
+    using ByCount = std::multimap<std::uint32_t, NetworkPrefix>;
+
+    auto Estimate(std::size_t hash) const -> std::uint32_t;
+    auto Insert(const NetworkPrefix& prefix, std::size_t hash, std::uint32_t estimate) -> void;
+    auto EvictBelow(std::uint32_t estimate) -> bool;
+    auto Raise(ByCount::iterator& entry, std::uint32_t count) -> void;
+    auto UpdateThreshold() -> void;
+
+    auto IsCandidate(std::size_t hash) const -> bool;
+    auto AddMember(std::size_t hash) -> void;
+    auto RemoveMember(std::size_t hash) -> void;
+    auto GetMemberHome(std::uint64_t member) const -> std::size_t;
+
+    std::array<std::array<std::atomic<std::uint32_t>, kWidth>, kDepth> counters_{};
+    const std::size_t capacity_;
+    // Minimal count in the full candidates table, lower estimates are rejected without locking
+    std::atomic<std::uint32_t> threshold_{0};
+    // Open-addressing set of the candidates' hashes, read without locking and written under the mutex.
+    // A reader racing with a removal may miss a candidate, it then takes the slow path.
+    std::vector<std::atomic<std::uint64_t>> members_;
+    mutable userver::engine::Mutex mutex_;
+    ByCount by_count_;
+    std::unordered_map<NetworkPrefix, ByCount::iterator, NetworkPrefixHash> candidates_;
+};
+
+}  // namespace slugkit::geo
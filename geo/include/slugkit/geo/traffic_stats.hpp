@@ -0,0 +1,104 @@
+#pragma once
+
+#include <slugkit/geo/lookup/result.hpp>
+#include <slugkit/geo/prefix_sketch.hpp>
+
+#include <userver/components/component_base.hpp>
+#include <userver/formats/common/type.hpp>
+#include <userver/formats/serialize/to.hpp>
+#include <userver/utils/fast_pimpl.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace slugkit::geo {
+
+/// @brief Merged view of the traffic counters.
+struct TrafficSnapshot {
+    struct Country {
+        std::string country_code;
+        std::uint64_t requests;
+        std::uint64_t unique_ips;  // HyperLogLog estimate
+    };
+    struct Asn {
+        std::uint32_t asn;
+        std::uint64_t requests;
+    };
+
+    std::uint64_t requests{0};
+    std::uint64_t unresolved{0};
+    std::uint64_t asn_overflow{0};      // Requests with an ASN that didn't fit into the full ASN tables
+    std::vector<Country> countries;     // The most requests first
+    std::vector<Asn> asns;              // The most requests first, up to the configured limit
+    std::vector<PrefixCount> prefixes;  // Heavy hitters, the most requests first, exponentially decayed counts
+};
+
+/// @brief Aggregated geo traffic distribution, a replacement for logging every resolved request.
+/// Counts requests per country and ASN in per-CPU shards without contention, estimates unique client IPs per
+/// country with HyperLogLog sketches and tracks the heaviest /24 and /48 prefixes with decaying counters.
+/// Shards are merged on read.
+/// ASNs come from the results, or from a separate ASN resolver if the results don't have them.
+/// Exported to the userver statistics as geo.traffic.* and via the handler-geo-traffic-stats endpoint.
+class TrafficStats : public userver::components::ComponentBase {
+public:
+    static constexpr std::string_view kName = "geoip-traffic-stats";
+
+    TrafficStats(
+        const userver::components::ComponentConfig& config,
+        const userver::components::ComponentContext& context
+    );
+    ~TrafficStats() override;
+
+    /// Lookup path, wait-free except for the rare heavy hitter table update which is skipped if busy,
+    /// and the ASN resolver lookup if the result has no ASN.
+    /// @param ip the client address the result was resolved for, requests from non-IP addresses are ignored
+    /// @param result nullptr if the address could not be resolved
+    auto Account(const std::string& ip, const lookup::LookupResult* result) -> void;
+
+    [[nodiscard]] auto GetSnapshot() const -> TrafficSnapshot;
+
+    static auto GetStaticConfigSchema() -> userver::yaml_config::Schema;
+
+private:
+    constexpr static auto kImplSize = 1024UL;
+    constexpr static auto kImplAlign = 8UL;
+    struct Impl;
+    userver::utils::FastPimpl<Impl, kImplSize, kImplAlign> impl_;
+};
+
+template <typename Format>
+auto Serialize(const TrafficSnapshot& snapshot, userver::formats::serialize::To<Format>) -> Format {
+    typename Format::Builder builder;
+    builder["requests"] = snapshot.requests;
+    builder["unresolved"] = snapshot.unresolved;
+    builder["asn_overflow"] = snapshot.asn_overflow;
+    typename Format::Builder countries{userver::formats::common::Type::kArray};
+    for (const auto& country : snapshot.countries) {
+        typename Format::Builder item;
+        item["country_code"] = country.country_code;
+        item["requests"] = country.requests;
+        item["unique_ips"] = country.unique_ips;
+        countries.PushBack(item.ExtractValue());
+    }
+    builder["countries"] = countries.ExtractValue();
+    typename Format::Builder asns{userver::formats::common::Type::kArray};
+    for (const auto& asn : snapshot.asns) {
+        typename Format::Builder item;
+        item["asn"] = asn.asn;
+        item["requests"] = asn.requests;
+        asns.PushBack(item.ExtractValue());
+    }
+    builder["asns"] = asns.ExtractValue();
+    typename Format::Builder prefixes{userver::formats::common::Type::kArray};
+    for (const auto& prefix : snapshot.prefixes) {
+        typename Format::Builder item;
+        item["prefix"] = prefix.prefix.ToString();
+        item["requests"] = prefix.count;
+        prefixes.PushBack(item.ExtractValue());
+    }
+    builder["prefixes"] = prefixes.ExtractValue();
+    return builder.ExtractValue();
+}
+
+}  // namespace slugkit::geo
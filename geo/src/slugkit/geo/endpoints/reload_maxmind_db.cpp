@@ -10,7 +10,11 @@ ReloadMaxmindDb::ReloadMaxmindDb(
     const userver::components::ComponentContext& context
 )
     : HttpHandlerBase(config, context)
-    , maxmind_db_lookup_(context.FindComponent<lookup::MaxmindDb>()) {
+    , snapshot_registry_(context.FindComponentOptional<lookup::MaxmindSnapshotRegistry>())
+    , maxmind_db_lookup_(
+          snapshot_registry_ ? context.FindComponentOptional<lookup::MaxmindDb>()
+                             : &context.FindComponent<lookup::MaxmindDb>()
+      ) {
 }
 
 auto ReloadMaxmindDb::HandleRequestThrow(
@@ -22,7 +26,13 @@ auto ReloadMaxmindDb::HandleRequestThrow(
 }
 
 auto ReloadMaxmindDb::Reload() const -> void {
-    maxmind_db_lookup_.Reload();
+    if (snapshot_registry_) {
+        snapshot_registry_->Reload();
+    }
+    // A file of its own is not known to the registry
+    if (maxmind_db_lookup_) {
+        maxmind_db_lookup_->Reload();
+    }
 }
 
 }  // namespace slugkit::geo::endpoints
\ No newline at end of file
@@ -0,0 +1,24 @@
+#include <slugkit/geo/endpoints/traffic_stats.hpp>
+
+#include <userver/components/component_config.hpp>
+#include <userver/components/component_context.hpp>
+
+namespace slugkit::geo::endpoints {
+
+TrafficStatsHandler::TrafficStatsHandler(
+    const userver::components::ComponentConfig& config,
+    const userver::components::ComponentContext& context
+)
+    : HttpHandlerJsonBase(config, context)
+    , traffic_stats_(context.FindComponent<TrafficStats>()) {
+}
+
+auto TrafficStatsHandler::HandleRequestJsonThrow(
+    [[maybe_unused]] const userver::server::http::HttpRequest& request,
+    [[maybe_unused]] const userver::formats::json::Value& request_json,
+    [[maybe_unused]] userver::server::request::RequestContext& context
+) const -> userver::formats::json::Value {
+    return Serialize(traffic_stats_.GetSnapshot(), userver::formats::serialize::To<userver::formats::json::Value>());
+}
+
+}  // namespace slugkit::geo::endpoints
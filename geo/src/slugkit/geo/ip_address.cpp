@@ -0,0 +1,36 @@
+#include <slugkit/geo/ip_address.hpp>
+
+#include <arpa/inet.h>
+
+#include <algorithm>
+
+namespace slugkit::geo {
+
+namespace {
+
+constexpr std::array<std::uint8_t, kIpv4MappedPrefixSize> kIpv4MappedPrefix{0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+
+}  // namespace
+
+auto ParseIpAddress(const std::string& ip) -> std::optional<IpAddress> {
+    IpAddress address;
+    if (ip.find(':') == std::string::npos) {
+        std::copy(kIpv4MappedPrefix.begin(), kIpv4MappedPrefix.end(), address.bytes.begin());
+        if (::inet_pton(AF_INET, ip.c_str(), address.bytes.data() + kIpv4MappedPrefixSize) != 1) {
+            return std::nullopt;
+        }
+        address.is_v4 = true;
+        return address;
+    }
+    if (::inet_pton(AF_INET6, ip.c_str(), address.bytes.data()) != 1) {
+        return std::nullopt;
+    }
+    address.is_v4 = IsIpv4Mapped(address.bytes);
+    return address;
+}
+
+auto IsIpv4Mapped(const std::array<std::uint8_t, 16>& bytes) -> bool {
+    return std::equal(kIpv4MappedPrefix.begin(), kIpv4MappedPrefix.end(), bytes.begin());
+}
+
+}  // namespace slugkit::geo
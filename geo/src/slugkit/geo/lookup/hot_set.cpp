@@ -0,0 +1,129 @@
+#include "hot_set.hpp"
+
+#include <userver/logging/log.hpp>
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <system_error>
+
+namespace slugkit::geo::lookup {
+
+namespace {
+
+constexpr std::string_view kMagic = "SGHS";
+constexpr std::size_t kHeaderSize = 12;
+constexpr std::size_t kEntrySize = 20;
+
+template <typename Integer>
+auto AppendLittleEndian(std::string& out, Integer value) -> void {
+    for (std::size_t i = 0; i < sizeof(Integer); ++i) {
+        out.push_back(static_cast<char>((value >> (i * 8)) & 0xff));
+    }
+}
+
+template <typename Integer>
+auto ReadLittleEndian(std::string_view data, std::size_t offset) -> Integer {
+    Integer value = 0;
+    for (std::size_t i = 0; i < sizeof(Integer); ++i) {
+        value |= static_cast<Integer>(static_cast<std::uint8_t>(data[offset + i])) << (i * 8);
+    }
+    return value;
+}
+
+}  // namespace
+
+HotSet::HotSet(std::string path, std::size_t capacity)
+    : path_(std::move(path))
+    , sketch_(capacity) {
+}
+
+auto HotSet::ReadFile() -> void {
+    std::ifstream file(path_, std::ios::binary);
+    if (!file) {
+        LOG_INFO() << "No hot set file at " << path_ << ", starting cold";
+        return;
+    }
+    std::string data{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+    try {
+        auto prefixes = Parse(data);
+        sketch_.Merge(prefixes);
+        LOG_INFO() << "Read " << prefixes.size() << " hot prefixes from " << path_;
+    } catch (const std::exception& e) {
+        LOG_WARNING() << "Ignoring hot set file " << path_ << ": " << e.what();
+    }
+}
+
+auto HotSet::WriteFile() -> void {
+    auto error = TryWriteFile(Serialize(GetPrefixes()));
+    // Decayed regardless, the counters must not wrap around while the file can't be written
+    sketch_.Decay();
+    if (!error.empty() && !write_failing_) {
+        LOG_ERROR() << error << ", further failures are not logged until a write succeeds";
+    } else if (error.empty() && write_failing_) {
+        LOG_INFO() << "Hot set file " << path_ << " is written again";
+    }
+    write_failing_ = !error.empty();
+}
+
+auto HotSet::TryWriteFile(const std::string& data) const -> std::string {
+    auto temp_path = path_ + ".tmp";
+    {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        file.write(data.data(), static_cast<std::streamsize>(data.size()));
+        file.flush();
+        if (!file) {
+            return "Failed to write hot set file " + temp_path;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temp_path, path_, error);
+    if (error) {
+        return "Failed to replace hot set file " + path_ + ": " + error.message();
+    }
+    return {};
+}
+
+auto HotSet::Serialize(const std::vector<PrefixCount>& prefixes) -> std::string {
+    std::string data;
+    data.reserve(kHeaderSize + prefixes.size() * kEntrySize);
+    data.append(kMagic);
+    AppendLittleEndian<std::uint16_t>(data, kFormatVersion);
+    AppendLittleEndian<std::uint16_t>(data, 0);
+    AppendLittleEndian<std::uint32_t>(data, static_cast<std::uint32_t>(prefixes.size()));
+    for (const auto& [prefix, count] : prefixes) {
+        data.append(reinterpret_cast<const char*>(prefix.bytes.data()), prefix.bytes.size());
+        AppendLittleEndian<std::uint32_t>(data, count);
+    }
+    return data;
+}
+
+auto HotSet::Parse(std::string_view data) -> std::vector<PrefixCount> {
+    if (data.size() < kHeaderSize || data.substr(0, kMagic.size()) != kMagic) {
+        throw std::runtime_error("not a hot set file");
+    }
+    auto version = ReadLittleEndian<std::uint16_t>(data, 4);
+    if (version != kFormatVersion) {
+        throw std::runtime_error(fmt::format("unsupported hot set format version {}", version));
+    }
+    auto count = ReadLittleEndian<std::uint32_t>(data, 8);
+    if (data.size() != kHeaderSize + static_cast<std::size_t>(count) * kEntrySize) {
+        throw std::runtime_error(fmt::format("hot set file size {} doesn't match {} entries", data.size(), count));
+    }
+    std::vector<PrefixCount> prefixes;
+    prefixes.reserve(count);
+    for (std::size_t offset = kHeaderSize; offset < data.size(); offset += kEntrySize) {
+        PrefixCount entry{};
+        std::copy_n(data.begin() + offset, entry.prefix.bytes.size(), entry.prefix.bytes.begin());
+        entry.count = ReadLittleEndian<std::uint32_t>(data, offset + entry.prefix.bytes.size());
+        // Normalise whatever is in the file to the prefix length the sketch uses
+        prefixes.push_back({NetworkPrefix::FromAddress(entry.prefix.ToAddress()), entry.count});
+    }
+    return prefixes;
+}
+
+}  // namespace slugkit::geo::lookup
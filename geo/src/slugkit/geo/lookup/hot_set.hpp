@@ -0,0 +1,58 @@
+#pragma once
+
+#include <slugkit/geo/prefix_sketch.hpp>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace slugkit::geo::lookup {
+
+/// @brief The most frequently looked up network prefixes, persisted to a local file.
+/// Used to warm up a freshly opened database before it starts serving lookups.
+///
+/// File format, all integers little-endian:
+/// - magic "SGHS", u16 version (1), u16 reserved (0), u32 entry count
+/// - entries: 16 bytes of prefix address (IPv4 as IPv4-mapped IPv6), u32 count
+class HotSet {
+public:
+    static constexpr std::uint16_t kFormatVersion = 1;
+
+    HotSet(std::string path, std::size_t capacity);
+
+    [[nodiscard]] auto GetPath() const -> const std::string& {
+        return path_;
+    }
+
+    /// Lookup path, never blocks
+    auto Record(const NetworkPrefix& prefix) -> void {
+        sketch_.Record(prefix);
+    }
+
+    /// The hottest prefixes first
+    [[nodiscard]] auto GetPrefixes() const -> std::vector<PrefixCount> {
+        return sketch_.GetTop();
+    }
+
+    /// Blocking. Merges the persisted prefixes, a missing or malformed file is logged and ignored.
+    auto ReadFile() -> void;
+
+    /// Blocking. Atomically replaces the file with the current prefixes, then decays the counters.
+    /// The counters are decayed even if the file can't be written, a failure is logged once until it recovers.
+    /// Not thread-safe, called by a single saver.
+    auto WriteFile() -> void;
+
+    [[nodiscard]] static auto Serialize(const std::vector<PrefixCount>& prefixes) -> std::string;
+    /// Throws std::runtime_error on a malformed or unsupported file
+    [[nodiscard]] static auto Parse(std::string_view data) -> std::vector<PrefixCount>;
+
+private:
+    /// Error message, empty on success
+    auto TryWriteFile(const std::string& data) const -> std::string;
+
+    const std::string path_;
+    PrefixSketch sketch_;
+    bool write_failing_{false};
+};
+
+}  // namespace slugkit::geo::lookup
@@ -1,84 +1,233 @@
 #include <slugkit/geo/lookup/maxmind_db_lookup.hpp>
 
+#include <slugkit/geo/ip_address.hpp>
+#include <slugkit/geo/lookup/maxmind_snapshot_registry.hpp>
+
+#include "hot_set.hpp"
+#include "maxmind_snapshot.hpp"
+
 #include <userver/components/component_config.hpp>
 #include <userver/components/component_context.hpp>
-#include <userver/engine/shared_mutex.hpp>
+#include <userver/concurrent/background_task_storage.hpp>
+#include <userver/engine/sleep.hpp>
+#include <userver/engine/task/cancel.hpp>
 #include <userver/logging/log.hpp>
+#include <userver/utils/async.hpp>
+#include <userver/utils/periodic_task.hpp>
 #include <userver/yaml_config/merge_schemas.hpp>
 #include <userver/yaml_config/yaml_config.hpp>
 
 #include <maxminddb.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
 namespace slugkit::geo::lookup {
 
+namespace {
+
+constexpr std::size_t kDefaultLanguage = 0;
+constexpr std::chrono::milliseconds kDefaultRetryInterval{10'000};
+constexpr std::chrono::milliseconds kDefaultHotSetSaveInterval{60'000};
+constexpr std::size_t kDefaultHotSetCapacity = 4096;
+
+/// Default language goes first, the rest keep the configured order without duplicates.
+auto MakeLanguages(const userver::components::ComponentConfig& config) -> std::vector<std::string> {
+    std::vector<std::string> languages{config["names-language"].As<std::string>("en")};
+    for (auto& language : config["names-languages"].As<std::vector<std::string>>({})) {
+        if (std::find(languages.begin(), languages.end(), language) == languages.end()) {
+            languages.push_back(std::move(language));
+        }
+    }
+    return languages;
+}
+
+/// Shared file from the registry if configured, a private one otherwise
+auto MakeFile(const userver::components::ComponentConfig& config, const userver::components::ComponentContext& context)
+    -> std::shared_ptr<MaxmindFile> {
+    auto path = config["database-dir"].As<std::string>() + "/" + config["database-file"].As<std::string>();
+    auto registry_name = config["snapshot-registry"].As<std::optional<std::string>>();
+    if (registry_name) {
+        return context.FindComponent<MaxmindSnapshotRegistry>(*registry_name).Acquire(path);
+    }
+    return std::make_shared<MaxmindFile>(std::move(path));
+}
+
+}  // namespace
+
 struct MaxmindDb::Impl {
-    mutable userver::engine::SharedMutex mutex_;
-    std::string database_file_;
-    MMDB_s database_;
-    std::string names_language_;
+    std::shared_ptr<MaxmindFile> file_;
+    // Names for all the languages are read from the same mapping, the database stores them deduplicated.
+    // Strings are never modified after construction, so their c_str() are used directly as lookup paths.
+    std::vector<std::string> languages_;
+    bool async_load_;
+    std::chrono::milliseconds retry_interval_;
+    userver::engine::TaskProcessor& fs_task_processor_;
+    // Configured for this component, attached to the file by the loader
+    std::shared_ptr<HotSet> configured_hot_set_;
+    // Shared with the other consumers of the file, the first attached one is used
+    std::shared_ptr<HotSet> hot_set_;
+    // Lookups record into the hot set once it is attached, concurrently with the loader
+    std::atomic<HotSet*> recorded_hot_set_{nullptr};
+    // Only the component that owns the file's hot set persists it
+    bool owns_hot_set_{false};
+    std::chrono::milliseconds hot_set_save_interval_{kDefaultHotSetSaveInterval};
+    userver::utils::PeriodicTask hot_set_saver_;
+    // Must be the last member, the loader task uses all of the above
+    userver::concurrent::BackgroundTaskStorage background_tasks_;
 
     Impl(const userver::components::ComponentConfig& config, const userver::components::ComponentContext& context)
-        : database_file_(config["database-dir"].As<std::string>() + "/" + config["database-file"].As<std::string>())
-        , database_{}
-        , names_language_(config["names-language"].As<std::string>("en")) {
-        auto status = MMDB_open(database_file_.c_str(), MMDB_MODE_MMAP, &database_);
-        if (status != MMDB_SUCCESS) {
-            throw std::runtime_error("Failed to open database file: " + database_file_);
+        : file_(MakeFile(config, context))
+        , languages_(MakeLanguages(config))
+        , async_load_(config["load-mode"].As<std::string>("sync") == "async")
+        , retry_interval_(config["load-retry-interval"].As<std::chrono::milliseconds>(kDefaultRetryInterval))
+        , fs_task_processor_(
+              context.GetTaskProcessor(config["fs-task-processor"].As<std::string>("fs-task-processor"))
+          ) {
+        // Checked by the file on every load, whichever consumer or the registry triggers it
+        file_->RequireLanguages(languages_);
+        ConfigureHotSet(config["hot-set"]);
+        if (!async_load_) {
+            AttachHotSet();
+            if (!Load()) {
+                throw std::runtime_error("Failed to open database file: " + file_->GetPath());
+            }
+            StartHotSetSaver();
+            return;
         }
+        file_->EnableWarmup();
+        background_tasks_.Detach(userver::utils::Async(fs_task_processor_, "maxmind-db-load", [this] {
+            LoadInBackground();
+        }));
     }
 
     ~Impl() {
-        if (database_.file_content) {
-            MMDB_close(&database_);
+        // The loader starts the saver, so it is stopped first
+        background_tasks_.CancelAndWait();
+        hot_set_saver_.Stop();
+    }
+
+    auto ConfigureHotSet(const userver::yaml_config::YamlConfig& config) -> void {
+        if (config.IsMissing()) {
+            return;
         }
+        configured_hot_set_ = std::make_shared<HotSet>(
+            config["path"].As<std::string>(), config["capacity"].As<std::size_t>(kDefaultHotSetCapacity)
+        );
+        hot_set_save_interval_ = config["save-interval"].As<std::chrono::milliseconds>(kDefaultHotSetSaveInterval);
     }
 
-    auto Reload() -> void {
-        LOG_INFO() << "Reloading MaxMind database from file: " << database_file_;
-        std::unique_lock lock(mutex_);
-        MMDB_s new_database = {};
-        auto status = MMDB_open(database_file_.c_str(), MMDB_MODE_MMAP, &new_database);
-        if (status != MMDB_SUCCESS) {
-            LOG_ERROR() << "Failed to open database file: " << database_file_;
+    /// Blocking, reads the persisted prefixes and prefetches them if another consumer has loaded the file.
+    /// Runs in the constructor in sync mode and on the loader task in async mode.
+    auto AttachHotSet() -> void {
+        if (!configured_hot_set_) {
+            return;
+        }
+        hot_set_ = file_->AttachHotSet(configured_hot_set_);
+        owns_hot_set_ = hot_set_ == configured_hot_set_;
+        if (!owns_hot_set_) {
+            LOG_INFO() << "MaxMind database file " << file_->GetPath() << " already has a hot set at "
+                       << hot_set_->GetPath() << ", using it";
+        }
+        recorded_hot_set_.store(hot_set_.get(), std::memory_order_release);
+    }
+
+    auto StartHotSetSaver() -> void {
+        if (!owns_hot_set_) {
             return;
         }
-        LOG_INFO() << "MaxMind database reloaded successfully";
-        MMDB_close(&database_);
-        std::swap(database_, new_database);
+        userver::utils::PeriodicTask::Settings settings{hot_set_save_interval_};
+        // Writing the file is blocking, lookups never wait for the sketch
+        settings.task_processor = &fs_task_processor_;
+        hot_set_saver_.Start("maxmind-hot-set-saver", settings, [this] { hot_set_->WriteFile(); });
+    }
+
+    /// Runs on the fs task processor until the database is loaded or the component is stopped
+    auto LoadInBackground() -> void {
+        LOG_INFO() << "Loading MaxMind database in background from file: " << file_->GetPath();
+        AttachHotSet();
+        while (!userver::engine::current_task::ShouldCancel()) {
+            if (Load()) {
+                StartHotSetSaver();
+                return;
+            }
+            userver::engine::InterruptibleSleepFor(retry_interval_);
+        }
+    }
+
+    /// A no-op if another consumer of the shared file has already loaded its current version
+    auto Load() -> bool {
+        return file_->Load();
     }
 
-    auto Lookup(const std::string& ip_str) const -> std::optional<LookupResult> {
+    auto Reload() -> void {
+        LOG_INFO() << "Reloading MaxMind database from file: " << file_->GetPath();
+        if (async_load_) {
+            // Keep the blocking file I/O off the caller's task processor
+            userver::utils::Async(fs_task_processor_, "maxmind-db-reload", [this] { Load(); }).Get();
+        } else {
+            Load();
+        }
+    }
+
+    auto FindLanguage(std::string_view language) const -> std::size_t {
+        auto it = std::find(languages_.begin(), languages_.end(), language);
+        return it == languages_.end() ? kDefaultLanguage : static_cast<std::size_t>(it - languages_.begin());
+    }
+
+    /// Localised name of the object, falls back to the default language when missing.
+    auto GetName(MMDB_entry_s& entry, const char* object, std::size_t language) const -> std::optional<std::string> {
+        MMDB_entry_data_s entry_data;
+        auto status = MMDB_get_value(&entry, &entry_data, object, "names", languages_[language].c_str(), nullptr);
+        if ((status != MMDB_SUCCESS || !entry_data.has_data) && language != kDefaultLanguage) {
+            status = MMDB_get_value(
+                &entry, &entry_data, object, "names", languages_[kDefaultLanguage].c_str(), nullptr
+            );
+        }
+        if (status != MMDB_SUCCESS || !entry_data.has_data) {
+            return std::nullopt;
+        }
+        return std::string(entry_data.utf8_string, entry_data.data_size);
+    }
+
+    auto Lookup(const std::string& ip_str, std::size_t language) const -> std::optional<LookupResult> {
         if (ip_str.empty()) {
             return std::nullopt;
         }
-        std::shared_lock lock(mutex_);
-        int gai_error = 0;
-        int mmdb_error = 0;
-        auto lookup_result = MMDB_lookup_string(&database_, ip_str.c_str(), &gai_error, &mmdb_error);
-        if (gai_error != 0) {
-            LOG_ERROR() << "Failed to lookup IP address: " << ip_str
-                        << " (getaddrinfo error: " << gai_strerror(gai_error) << ")";
+        // Holding the snapshot keeps it alive, a concurrent reload doesn't affect this lookup
+        auto snapshot = file_->Read();
+        if (!*snapshot) {
+            return std::nullopt;
+        }
+        // Parsed in place instead of MMDB_lookup_string, which goes through getaddrinfo
+        auto address = ParseIpAddress(ip_str);
+        if (!address) {
+            LOG_DEBUG() << "Failed to lookup IP address: " << ip_str << " (not an IP address)";
             return std::nullopt;
         }
+        if (auto* hot_set = recorded_hot_set_.load(std::memory_order_acquire)) {
+            hot_set->Record(NetworkPrefix::FromAddress(*address));
+        }
+        int mmdb_error = 0;
+        auto lookup_result = (*snapshot)->Lookup(*address, &mmdb_error);
         if (mmdb_error != 0) {
             LOG_ERROR() << "Failed to lookup IP address: " << ip_str << " (mmdb_error: " << MMDB_strerror(mmdb_error)
                         << ")";
             return std::nullopt;
         }
         if (!lookup_result.found_entry) {
-            LOG_ERROR() << "Failed to lookup IP address: " << ip_str << " (not found)";
+            LOG_DEBUG() << "Failed to lookup IP address: " << ip_str << " (not found)";
             return std::nullopt;
         }
         LookupResult result;
         MMDB_entry_data_s entry_data;
-        MMDB_get_value(&lookup_result.entry, &entry_data, "country", "iso_code", nullptr);
-        result.country_code = std::string(entry_data.utf8_string, entry_data.data_size);
-        MMDB_get_value(&lookup_result.entry, &entry_data, "country", "names", names_language_.c_str(), nullptr);
-        result.country_name = std::string(entry_data.utf8_string, entry_data.data_size);
-        MMDB_get_value(&lookup_result.entry, &entry_data, "city", "names", names_language_.c_str(), nullptr);
-        if (entry_data.has_data) {
-            result.city_name = std::string(entry_data.utf8_string, entry_data.data_size);
+        auto status = MMDB_get_value(&lookup_result.entry, &entry_data, "country", "iso_code", nullptr);
+        if (status == MMDB_SUCCESS && entry_data.has_data) {
+            result.country_code = std::string(entry_data.utf8_string, entry_data.data_size);
         }
+        result.country_name = GetName(lookup_result.entry, "country", language).value_or(std::string{});
+        result.city_name = GetName(lookup_result.entry, "city", language);
         MMDB_get_value(&lookup_result.entry, &entry_data, "location", "time_zone", nullptr);
         if (entry_data.has_data) {
             result.time_zone = std::string(entry_data.utf8_string, entry_data.data_size);
@@ -91,6 +240,11 @@ struct MaxmindDb::Impl {
                 result.coordinates = Coordinates{latitude, entry_data.double_value};
             }
         }
+        // Only in the ASN databases
+        status = MMDB_get_value(&lookup_result.entry, &entry_data, "autonomous_system_number", nullptr);
+        if (status == MMDB_SUCCESS && entry_data.has_data) {
+            result.asn = entry_data.uint32;
+        }
         return result;
     }
 };
@@ -109,8 +263,36 @@ auto MaxmindDb::Reload() -> void {
     impl_->Reload();
 }
 
+auto MaxmindDb::IsReady() const -> bool {
+    return impl_->file_->IsLoaded();
+}
+
+auto MaxmindDb::GetDataVersion() const -> std::uint64_t {
+    auto snapshot = impl_->file_->Read();
+    return *snapshot ? (*snapshot)->GetDatabase().metadata.build_epoch : 0;
+}
+
+auto MaxmindDb::GetDataSource() const -> std::uint64_t {
+    auto snapshot = impl_->file_->Read();
+    return *snapshot ? (*snapshot)->GetTypeHash() : 0;
+}
+
+auto MaxmindDb::GetComponentHealth() const -> userver::components::ComponentHealth {
+    // Not fatal: the service keeps serving requests without geo data until the database is loaded
+    return IsReady() ? userver::components::ComponentHealth::kOk : userver::components::ComponentHealth::kFallback;
+}
+
 auto MaxmindDb::Lookup(const std::string& ip_str) const -> std::optional<LookupResult> {
-    return impl_->Lookup(ip_str);
+    return impl_->Lookup(ip_str, kDefaultLanguage);
+}
+
+auto MaxmindDb::LookupLocalized(const std::string& ip_str, std::string_view language) const
+    -> std::optional<LookupResult> {
+    return impl_->Lookup(ip_str, impl_->FindLanguage(language));
+}
+
+auto MaxmindDb::GetLanguages() const -> std::vector<std::string> {
+    return impl_->languages_;
 }
 
 auto MaxmindDb::GetStaticConfigSchema() -> userver::yaml_config::Schema {
@@ -127,8 +309,58 @@ properties:
         description: The name of the MaxMind database file
     names-language:
         type: string
-        description: The language for the names in the MaxMind database
+        description: The default language for the names in the MaxMind database
         defaultDescription: en
+    names-languages:
+        type: array
+        items:
+            type: string
+            description: Language code as in the MaxMind database (e.g., de, pt-BR, zh-CN)
+        description: |
+            Additional languages for the names, selected per request (e.g., by the middleware from Accept-Language).
+            All languages share the same database mapping. Missing names fall back to names-language.
+        defaultDescription: empty array
+    load-mode:
+        type: string
+        enum: [sync, async]
+        description: |
+            sync: the database is opened in the constructor, startup fails if it can't be opened.
+            async: the component starts immediately, the database is opened and warmed up on the fs task processor
+            and retried until it succeeds. Lookups return nothing until then.
+        defaultDescription: sync
+    load-retry-interval:
+        type: string
+        description: Interval between attempts to open the database in async mode
+        defaultDescription: 10s
+    fs-task-processor:
+        type: string
+        description: Task processor for the blocking file operations in async mode
+        defaultDescription: fs-task-processor
+    snapshot-registry:
+        type: string
+        description: |
+            Name of the maxmind-snapshot-registry component to share the opened database file with other components.
+            Without it the component maps the file on its own.
+    hot-set:
+        type: object
+        description: |
+            Persisted set of the most frequently looked up network prefixes (/24 for IPv4, /48 for IPv6).
+            Whenever the database is (re)loaded, the prefixes are resolved against the new snapshot before it starts
+            serving lookups. Components sharing the file via the registry share its hot set.
+        additionalProperties: false
+        properties:
+            path:
+                type: string
+                description: Path to the hot set file
+            capacity:
+                type: integer
+                minimum: 0
+                description: Number of the hottest prefixes to keep
+                defaultDescription: 4096
+            save-interval:
+                type: string
+                description: Interval between writes of the hot set file
+                defaultDescription: 1m
 )");
 }
 
@@ -0,0 +1,200 @@
+#include "maxmind_snapshot.hpp"
+
+#include <userver/logging/log.hpp>
+
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+
+namespace slugkit::geo::lookup {
+
+auto GetFileIdentity(const std::string& path) -> std::optional<FileIdentity> {
+    struct stat file_stat {};
+    if (::stat(path.c_str(), &file_stat) != 0) {
+        return std::nullopt;
+    }
+    constexpr std::int64_t kNanosecondsInSecond = 1'000'000'000;
+    return FileIdentity{
+        file_stat.st_dev,
+        file_stat.st_ino,
+        static_cast<std::int64_t>(file_stat.st_mtim.tv_sec) * kNanosecondsInSecond + file_stat.st_mtim.tv_nsec
+    };
+}
+
+MaxmindSnapshot::MaxmindSnapshot(const std::string& path, FileIdentity identity)
+    : identity_(identity) {
+    auto status = MMDB_open(path.c_str(), MMDB_MODE_MMAP, &database_);
+    if (status != MMDB_SUCCESS) {
+        throw std::runtime_error("Failed to open database file: " + path + " (" + MMDB_strerror(status) + ")");
+    }
+    if (database_.metadata.database_type) {
+        type_hash_ = HashString(database_.metadata.database_type);
+    }
+}
+
+MaxmindSnapshot::~MaxmindSnapshot() {
+    if (database_.file_content) {
+        MMDB_close(&database_);
+    }
+}
+
+auto MaxmindSnapshot::HasLanguage(std::string_view language) const -> bool {
+    const auto& languages = database_.metadata.languages;
+    for (std::size_t i = 0; i < languages.count; ++i) {
+        if (language == languages.names[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+auto MaxmindSnapshot::Lookup(const IpAddress& address, int* mmdb_error) const -> MMDB_lookup_result_s {
+    if (address.is_v4) {
+        sockaddr_in sockaddr{};
+        sockaddr.sin_family = AF_INET;
+        std::memcpy(&sockaddr.sin_addr, address.bytes.data() + kIpv4MappedPrefixSize, sizeof(sockaddr.sin_addr));
+        return MMDB_lookup_sockaddr(&database_, reinterpret_cast<const struct sockaddr*>(&sockaddr), mmdb_error);
+    }
+    sockaddr_in6 sockaddr{};
+    sockaddr.sin6_family = AF_INET6;
+    std::memcpy(&sockaddr.sin6_addr, address.bytes.data(), sizeof(sockaddr.sin6_addr));
+    return MMDB_lookup_sockaddr(&database_, reinterpret_cast<const struct sockaddr*>(&sockaddr), mmdb_error);
+}
+
+auto MaxmindSnapshot::Prefetch(const std::vector<PrefixCount>& prefixes) const -> std::size_t {
+    std::size_t found = 0;
+    for (const auto& [prefix, count] : prefixes) {
+        int mmdb_error = 0;
+        auto result = Lookup(prefix.ToAddress(), &mmdb_error);
+        if (mmdb_error != MMDB_SUCCESS || !result.found_entry) {
+            continue;
+        }
+        MMDB_entry_data_list_s* entry_data_list = nullptr;
+        if (MMDB_get_entry_data_list(&result.entry, &entry_data_list) == MMDB_SUCCESS) {
+            ++found;
+        }
+        MMDB_free_entry_data_list(entry_data_list);
+    }
+    return found;
+}
+
+auto MaxmindSnapshot::Warmup() const -> void {
+    if (!database_.file_content || database_.file_size <= 0) {
+        return;
+    }
+    auto* content = const_cast<std::uint8_t*>(database_.file_content);
+    auto size = static_cast<std::size_t>(database_.file_size);
+    ::madvise(content, size, MADV_WILLNEED);
+    const auto page_size = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    std::uint8_t checksum = 0;
+    for (std::size_t offset = 0; offset < size; offset += page_size) {
+        checksum ^= *static_cast<volatile const std::uint8_t*>(content + offset);
+    }
+    LOG_DEBUG() << "MaxMind database warmed up, " << size << " bytes, checksum " << static_cast<int>(checksum);
+}
+
+MaxmindFile::MaxmindFile(std::string path)
+    : path_(std::move(path)) {
+}
+
+auto MaxmindFile::CheckLanguage(const MaxmindSnapshot& snapshot, const std::string& language) const -> void {
+    if (!snapshot.HasLanguage(language)) {
+        LOG_WARNING() << "MaxMind database " << path_ << " has no names in language: " << language;
+    }
+}
+
+auto MaxmindFile::PrefetchHotSet(const MaxmindSnapshot& snapshot) const -> void {
+    auto prefixes = hot_set_->GetPrefixes();
+    auto found = snapshot.Prefetch(prefixes);
+    LOG_INFO() << "Prefetched " << found << " of " << prefixes.size() << " hot prefixes from " << path_;
+}
+
+auto MaxmindFile::RequireLanguages(const std::vector<std::string>& languages) -> void {
+    std::vector<std::string> added;
+    {
+        std::lock_guard languages_lock(languages_mutex_);
+        for (const auto& language : languages) {
+            if (std::find(languages_.begin(), languages_.end(), language) == languages_.end()) {
+                languages_.push_back(language);
+                added.push_back(language);
+            }
+        }
+    }
+    // Another consumer may have loaded the file already. A load that copied the languages before they were added
+    // has assigned its snapshot by now, so it is checked here.
+    auto snapshot = snapshot_.Read();
+    if (*snapshot) {
+        for (const auto& language : added) {
+            CheckLanguage(**snapshot, language);
+        }
+    }
+}
+
+auto MaxmindFile::AttachHotSet(std::shared_ptr<HotSet> hot_set) -> std::shared_ptr<HotSet> {
+    {
+        // Under the load lock, so that a load in progress either prefetches the persisted prefixes or is done
+        std::lock_guard load_lock(load_mutex_);
+        if (hot_set_) {
+            return hot_set_;
+        }
+        hot_set_ = std::move(hot_set);
+        hot_set_->ReadFile();
+    }
+    // Set once, never changed after this point
+    auto snapshot = snapshot_.Read();
+    if (*snapshot) {
+        PrefetchHotSet(**snapshot);
+    }
+    return hot_set_;
+}
+
+auto MaxmindFile::Load() -> bool {
+    std::lock_guard load_lock(load_mutex_);
+    auto identity = GetFileIdentity(path_);
+    if (!identity) {
+        LOG_ERROR() << "Failed to open database file: " << path_ << " (no such file or no access)";
+        return false;
+    }
+    {
+        auto current = snapshot_.Read();
+        if (*current && (*current)->GetIdentity() == *identity) {
+            LOG_INFO() << "MaxMind database file " << path_ << " has not changed, reusing the loaded snapshot";
+            return true;
+        }
+    }
+
+    MaxmindSnapshotPtr snapshot;
+    try {
+        snapshot = std::make_shared<const MaxmindSnapshot>(path_, *identity);
+    } catch (const std::exception& e) {
+        LOG_ERROR() << e.what();
+        return false;
+    }
+    if (warmup_) {
+        snapshot->Warmup();
+    }
+    if (hot_set_) {
+        PrefetchHotSet(*snapshot);
+    }
+    // Lookups continue on the previous snapshot until this point, it is released by its last reader
+    snapshot_.Assign(snapshot);
+    loaded_.store(true, std::memory_order_release);
+    std::vector<std::string> languages;
+    {
+        std::lock_guard languages_lock(languages_mutex_);
+        languages = languages_;
+    }
+    for (const auto& language : languages) {
+        CheckLanguage(*snapshot, language);
+    }
+    LOG_INFO() << "MaxMind database loaded successfully from file: " << path_;
+    return true;
+}
+
+}  // namespace slugkit::geo::lookup
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "hot_set.hpp"
+
+#include <slugkit/geo/ip_address.hpp>
+
+#include <userver/engine/mutex.hpp>
+#include <userver/rcu/rcu.hpp>
+
+#include <maxminddb.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace slugkit::geo::lookup {
+
+/// @brief Identifies the file contents on disk.
+/// Updaters replace database files by renaming or rewriting them, both change the identity.
+struct FileIdentity {
+    dev_t device;
+    ino_t inode;
+    std::int64_t mtime_ns;
+
+    auto operator==(const FileIdentity& other) const -> bool = default;
+};
+
+/// Blocking, std::nullopt if the file doesn't exist or can't be accessed
+auto GetFileIdentity(const std::string& path) -> std::optional<FileIdentity>;
+
+/// @brief An opened and memory-mapped MaxMind database file. Immutable once opened.
+class MaxmindSnapshot {
+public:
+    /// Blocking, throws std::runtime_error if the file can't be opened
+    MaxmindSnapshot(const std::string& path, FileIdentity identity);
+    ~MaxmindSnapshot();
+
+    MaxmindSnapshot(const MaxmindSnapshot&) = delete;
+    auto operator=(const MaxmindSnapshot&) -> MaxmindSnapshot& = delete;
+
+    [[nodiscard]] auto GetDatabase() const -> const MMDB_s& {
+        return database_;
+    }
+    [[nodiscard]] auto GetIdentity() const -> const FileIdentity& {
+        return identity_;
+    }
+    /// HashString() of the database type from the metadata
+    [[nodiscard]] auto GetTypeHash() const -> std::uint64_t {
+        return type_hash_;
+    }
+    [[nodiscard]] auto HasLanguage(std::string_view language) const -> bool;
+
+    [[nodiscard]] auto Lookup(const IpAddress& address, int* mmdb_error) const -> MMDB_lookup_result_s;
+
+    /// Faults in all pages of the mapping, so that the first lookups don't wait for the disk. Blocking.
+    auto Warmup() const -> void;
+
+    /// Resolves the prefixes and decodes their records, so that their pages are resident. Blocking.
+    /// Returns the number of prefixes found in the database.
+    auto Prefetch(const std::vector<PrefixCount>& prefixes) const -> std::size_t;
+
+private:
+    MMDB_s database_{};
+    FileIdentity identity_;
+    std::uint64_t type_hash_{0};
+};
+
+using MaxmindSnapshotPtr = std::shared_ptr<const MaxmindSnapshot>;
+
+/// @brief A database file shared by all of its consumers.
+/// Holds the current snapshot, which is replaced when the file changes on disk.
+class MaxmindFile {
+public:
+    explicit MaxmindFile(std::string path);
+
+    [[nodiscard]] auto GetPath() const -> const std::string& {
+        return path_;
+    }
+
+    /// Current snapshot, null until the file is loaded. Keeps the snapshot alive while held.
+    [[nodiscard]] auto Read() const -> userver::rcu::ReadablePtr<MaxmindSnapshotPtr> {
+        return snapshot_.Read();
+    }
+
+    [[nodiscard]] auto IsLoaded() const -> bool {
+        return loaded_.load(std::memory_order_acquire);
+    }
+
+    /// Languages the consumers need names in, every newly loaded snapshot is checked for them. Doesn't wait for
+    /// a load in progress.
+    auto RequireLanguages(const std::vector<std::string>& languages) -> void;
+
+    /// Warm up the snapshots on load, sticky once requested by any consumer
+    auto EnableWarmup() -> void {
+        warmup_ = true;
+    }
+
+    /// Hot set of the file, shared by all of its consumers. The first attached one wins and is returned.
+    /// The winner's persisted prefixes are read right away, and prefetched if the file is already loaded,
+    /// so the warm start doesn't depend on which consumer loads the file first.
+    /// Blocking, waits for a load in progress. Should be called on the fs task processor or where loading is fine.
+    auto AttachHotSet(std::shared_ptr<HotSet> hot_set) -> std::shared_ptr<HotSet>;
+
+    /// Opens the file if it has not been loaded yet or its identity changed since.
+    /// A new snapshot is prefetched with the hot set before it replaces the current one.
+    /// Repeated calls by other consumers are no-ops until the file changes again.
+    /// Blocking, should be called on the fs task processor. Returns false if the file can't be opened.
+    auto Load() -> bool;
+
+private:
+    auto CheckLanguage(const MaxmindSnapshot& snapshot, const std::string& language) const -> void;
+    auto PrefetchHotSet(const MaxmindSnapshot& snapshot) const -> void;
+
+    const std::string path_;
+    userver::rcu::Variable<MaxmindSnapshotPtr> snapshot_;
+    userver::engine::Mutex load_mutex_;
+    std::shared_ptr<HotSet> hot_set_;
+    // Never held during file I/O, consumers register their languages without waiting for a load
+    userver::engine::Mutex languages_mutex_;
+    std::vector<std::string> languages_;
+    std::atomic<bool> loaded_{false};
+    std::atomic<bool> warmup_{false};
+};
+
+}  // namespace slugkit::geo::lookup
@@ -0,0 +1,92 @@
+#include <slugkit/geo/lookup/maxmind_snapshot_registry.hpp>
+
+#include "maxmind_snapshot.hpp"
+
+#include <userver/components/component_config.hpp>
+#include <userver/components/component_context.hpp>
+#include <userver/engine/mutex.hpp>
+#include <userver/logging/log.hpp>
+#include <userver/utils/async.hpp>
+#include <userver/yaml_config/merge_schemas.hpp>
+#include <userver/yaml_config/yaml_config.hpp>
+
+#include <filesystem>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace slugkit::geo::lookup {
+
+struct MaxmindSnapshotRegistry::Impl {
+    userver::engine::TaskProcessor& fs_task_processor_;
+    userver::engine::Mutex mutex_;
+    std::unordered_map<std::string, std::shared_ptr<MaxmindFile>> files_;
+
+    Impl(const userver::components::ComponentConfig& config, const userver::components::ComponentContext& context)
+        : fs_task_processor_(
+              context.GetTaskProcessor(config["fs-task-processor"].As<std::string>("fs-task-processor"))
+          ) {
+    }
+
+    auto Acquire(const std::string& path) -> std::shared_ptr<MaxmindFile> {
+        // The file may not exist yet with async loading, so no strict canonical()
+        auto canonical_path = std::filesystem::weakly_canonical(path).string();
+        std::lock_guard lock(mutex_);
+        auto& file = files_[canonical_path];
+        if (!file) {
+            LOG_INFO() << "Registered MaxMind database file: " << canonical_path;
+            file = std::make_shared<MaxmindFile>(canonical_path);
+        }
+        return file;
+    }
+
+    auto Reload() -> void {
+        std::vector<std::shared_ptr<MaxmindFile>> files;
+        {
+            std::lock_guard lock(mutex_);
+            files.reserve(files_.size());
+            for (const auto& [path, file] : files_) {
+                files.push_back(file);
+            }
+        }
+        userver::utils::Async(fs_task_processor_, "maxmind-registry-reload", [&files] {
+            for (const auto& file : files) {
+                LOG_INFO() << "Reloading MaxMind database from file: " << file->GetPath();
+                file->Load();
+            }
+        }).Get();
+    }
+};
+
+MaxmindSnapshotRegistry::MaxmindSnapshotRegistry(
+    const userver::components::ComponentConfig& config,
+    const userver::components::ComponentContext& context
+)
+    : userver::components::ComponentBase(config, context)
+    , impl_{config, context} {
+}
+
+MaxmindSnapshotRegistry::~MaxmindSnapshotRegistry() = default;
+
+auto MaxmindSnapshotRegistry::Acquire(const std::string& path) -> std::shared_ptr<MaxmindFile> {
+    return impl_->Acquire(path);
+}
+
+auto MaxmindSnapshotRegistry::Reload() -> void {
+    impl_->Reload();
+}
+
+auto MaxmindSnapshotRegistry::GetStaticConfigSchema() -> userver::yaml_config::Schema {
+    return userver::yaml_config::MergeSchemas<userver::components::ComponentBase>(R"(
+type: object
+description: Process-wide registry of MaxMind database files shared by the lookup components
+additionalProperties: false
+properties:
+    fs-task-processor:
+        type: string
+        description: Task processor for the blocking file operations on reload
+        defaultDescription: fs-task-processor
+)");
+}
+
+}  // namespace slugkit::geo::lookup
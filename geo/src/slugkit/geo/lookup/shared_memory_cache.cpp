@@ -0,0 +1,290 @@
+#include <slugkit/geo/lookup/shared_memory_cache.hpp>
+
+#include "shared_memory_table.hpp"
+
+#include <slugkit/geo/ip_address.hpp>
+
+#include <userver/components/component_config.hpp>
+#include <userver/components/component_context.hpp>
+#include <userver/logging/log.hpp>
+#include <userver/yaml_config/merge_schemas.hpp>
+#include <userver/yaml_config/yaml_config.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+
+namespace slugkit::geo::lookup {
+
+namespace {
+
+constexpr std::size_t kDefaultCapacity = 65536;
+
+// Packed result layout: flags, 4 string lengths, padding, latitude, longitude, ASN, then the strings.
+// The format version is a part of the key, so that processes with different formats don't read each other's entries.
+constexpr std::uint32_t kPayloadFormatVersion = 2;
+constexpr std::uint8_t kHasCityName = 1;
+constexpr std::uint8_t kHasTimeZone = 2;
+constexpr std::uint8_t kHasCoordinates = 4;
+constexpr std::uint8_t kHasAsn = 8;
+constexpr std::size_t kLengthsOffset = 1;
+constexpr std::size_t kLatitudeOffset = 8;
+constexpr std::size_t kLongitudeOffset = 16;
+constexpr std::size_t kAsnOffset = 24;
+constexpr std::size_t kStringsOffset = 28;
+constexpr std::size_t kPayloadSize = SharedMemoryTable::kPayloadWords * sizeof(std::uint64_t);
+constexpr std::size_t kMaxStringLength = 255;
+
+using Payload = SharedMemoryTable::Payload;
+
+/// std::nullopt if the strings don't fit into a slot, such results are not cached
+auto Pack(const LookupResult& result) -> std::optional<Payload> {
+    const std::string_view strings[] = {
+        result.country_code,
+        result.country_name,
+        result.city_name ? std::string_view{*result.city_name} : std::string_view{},
+        result.time_zone ? std::string_view{*result.time_zone} : std::string_view{},
+    };
+    std::array<std::uint8_t, kPayloadSize> bytes{};
+    bytes[0] = (result.city_name ? kHasCityName : 0) | (result.time_zone ? kHasTimeZone : 0) |
+               (result.coordinates ? kHasCoordinates : 0) | (result.asn ? kHasAsn : 0);
+    if (result.coordinates) {
+        std::memcpy(bytes.data() + kLatitudeOffset, &result.coordinates->latitude, sizeof(double));
+        std::memcpy(bytes.data() + kLongitudeOffset, &result.coordinates->longitude, sizeof(double));
+    }
+    if (result.asn) {
+        std::memcpy(bytes.data() + kAsnOffset, &*result.asn, sizeof(std::uint32_t));
+    }
+    auto offset = kStringsOffset;
+    for (std::size_t i = 0; i < std::size(strings); ++i) {
+        const auto& string = strings[i];
+        if (string.size() > kMaxStringLength || offset + string.size() > bytes.size()) {
+            return std::nullopt;
+        }
+        bytes[kLengthsOffset + i] = static_cast<std::uint8_t>(string.size());
+        std::memcpy(bytes.data() + offset, string.data(), string.size());
+        offset += string.size();
+    }
+    Payload payload{};
+    std::memcpy(payload.data(), bytes.data(), bytes.size());
+    return payload;
+}
+
+auto Unpack(const Payload& payload) -> std::optional<LookupResult> {
+    std::array<std::uint8_t, kPayloadSize> bytes{};
+    std::memcpy(bytes.data(), payload.data(), bytes.size());
+    std::string strings[4];
+    auto offset = kStringsOffset;
+    for (std::size_t i = 0; i < std::size(strings); ++i) {
+        auto length = bytes[kLengthsOffset + i];
+        if (offset + length > bytes.size()) {
+            return std::nullopt;
+        }
+        strings[i].assign(reinterpret_cast<const char*>(bytes.data() + offset), length);
+        offset += length;
+    }
+    LookupResult result;
+    result.country_code = std::move(strings[0]);
+    result.country_name = std::move(strings[1]);
+    if (bytes[0] & kHasCityName) {
+        result.city_name = std::move(strings[2]);
+    }
+    if (bytes[0] & kHasTimeZone) {
+        result.time_zone = std::move(strings[3]);
+    }
+    if (bytes[0] & kHasCoordinates) {
+        Coordinates coordinates{};
+        std::memcpy(&coordinates.latitude, bytes.data() + kLatitudeOffset, sizeof(double));
+        std::memcpy(&coordinates.longitude, bytes.data() + kLongitudeOffset, sizeof(double));
+        result.coordinates = coordinates;
+    }
+    if (bytes[0] & kHasAsn) {
+        std::uint32_t asn = 0;
+        std::memcpy(&asn, bytes.data() + kAsnOffset, sizeof(asn));
+        result.asn = asn;
+    }
+    return result;
+}
+
+/// Payload format version and the language, stable across processes
+auto KeyVariant(std::string_view language) -> std::uint32_t {
+    return static_cast<std::uint32_t>(MixHash(HashString(language) ^ kPayloadFormatVersion));
+}
+
+}  // namespace
+
+struct SharedMemoryCache::Impl {
+    std::vector<ComponentBase const*> resolvers_;
+    // Processes may have different defaults, so results for the default language are cached under its name
+    std::string default_language_;
+    std::unique_ptr<SharedMemoryTable> table_;
+    // The data tag this process has last published
+    mutable std::atomic<std::uint64_t> published_tag_{0};
+
+    Impl(const userver::components::ComponentConfig& config, const userver::components::ComponentContext& context) {
+        for (const auto& resolver_name : config["resolvers"].As<std::vector<std::string>>()) {
+            resolvers_.push_back(&context.FindComponent<ComponentBase>(resolver_name));
+        }
+        if (resolvers_.empty()) {
+            throw std::runtime_error("No geoip resolvers provided");
+        }
+        auto languages = resolvers_.front()->GetLanguages();
+        if (!languages.empty()) {
+            default_language_ = languages.front();
+        }
+
+        auto segment_name = config["segment-name"].As<std::string>();
+        try {
+            table_ = std::make_unique<SharedMemoryTable>(
+                segment_name, config["capacity"].As<std::size_t>(kDefaultCapacity)
+            );
+        } catch (const std::exception& e) {
+            // Still usable, just without the cache
+            LOG_ERROR() << "Shared memory cache is disabled: " << e.what();
+        }
+    }
+
+    /// Identifies the data the results come from: the versions and the kinds of the ready resolvers' data.
+    /// Editions of the same build (City, Country, ASN) get different tags, so a segment shared by caches over
+    /// different databases never serves one's results to the other. 0 if no resolver has a data version.
+    auto GetUpstreamTag() const -> std::uint64_t {
+        std::uint64_t tag = 0;
+        for (const auto resolver : resolvers_) {
+            if (!resolver->IsReady()) {
+                continue;
+            }
+            if (auto version = resolver->GetDataVersion(); version != 0) {
+                tag = MixHash(tag ^ MixHash(version ^ MixHash(resolver->GetDataSource())));
+            }
+        }
+        return tag == 0 ? 0 : tag | 1;
+    }
+
+    auto GetUpstreamVersion() const -> std::uint64_t {
+        std::uint64_t version = 0;
+        for (const auto resolver : resolvers_) {
+            if (resolver->IsReady()) {
+                version = std::max(version, resolver->GetDataVersion());
+            }
+        }
+        return version;
+    }
+
+    auto ResolveUpstream(const std::string& ip, std::string_view language) const -> std::optional<LookupResult> {
+        for (const auto resolver : resolvers_) {
+            if (!resolver->IsReady()) {
+                continue;
+            }
+            if (auto result = resolver->LookupLocalized(ip, language)) {
+                return result;
+            }
+        }
+        return std::nullopt;
+    }
+
+    auto Lookup(const std::string& ip, std::string_view language) const -> std::optional<LookupResult> {
+        auto address = table_ ? ParseIpAddress(ip) : std::nullopt;
+        if (!address) {
+            return ResolveUpstream(ip, language);
+        }
+        SharedMemoryTable::Key key{address->bytes, KeyVariant(language.empty() ? default_language_ : language)};
+
+        // Until the own data is loaded, serve what the other processes cached for the data loaded last
+        auto upstream_tag = GetUpstreamTag();
+        auto tag = upstream_tag;
+        if (tag == 0) {
+            tag = table_->GetPublishedEpoch();
+        } else if (published_tag_.load(std::memory_order_relaxed) != tag) {
+            published_tag_.store(tag, std::memory_order_relaxed);
+            table_->PublishEpoch(tag);
+        }
+        if (tag != 0) {
+            Payload payload;
+            if (table_->Find(key, tag, payload)) {
+                if (auto result = Unpack(payload)) {
+                    return result;
+                }
+            }
+        }
+
+        auto result = ResolveUpstream(ip, language);
+        if (result && upstream_tag != 0) {
+            if (auto payload = Pack(*result)) {
+                table_->Store(key, upstream_tag, *payload);
+            }
+        }
+        return result;
+    }
+};
+
+SharedMemoryCache::SharedMemoryCache(
+    const userver::components::ComponentConfig& config,
+    const userver::components::ComponentContext& context
+)
+    : ComponentBase(config, context)
+    , impl_{config, context} {
+}
+
+SharedMemoryCache::~SharedMemoryCache() = default;
+
+auto SharedMemoryCache::Lookup(const std::string& ip) const -> std::optional<LookupResult> {
+    return impl_->Lookup(ip, {});
+}
+
+auto SharedMemoryCache::LookupLocalized(const std::string& ip, std::string_view language) const
+    -> std::optional<LookupResult> {
+    return impl_->Lookup(ip, language);
+}
+
+auto SharedMemoryCache::GetLanguages() const -> std::vector<std::string> {
+    std::vector<std::string> languages;
+    for (const auto resolver : impl_->resolvers_) {
+        for (auto& language : resolver->GetLanguages()) {
+            if (std::find(languages.begin(), languages.end(), language) == languages.end()) {
+                languages.push_back(std::move(language));
+            }
+        }
+    }
+    return languages;
+}
+
+auto SharedMemoryCache::IsReady() const -> bool {
+    return std::any_of(impl_->resolvers_.begin(), impl_->resolvers_.end(), [](auto resolver) {
+               return resolver->IsReady();
+           }) ||
+           (impl_->table_ && impl_->table_->GetPublishedEpoch() != 0);
+}
+
+auto SharedMemoryCache::GetDataVersion() const -> std::uint64_t {
+    return impl_->GetUpstreamVersion();
+}
+
+auto SharedMemoryCache::GetStaticConfigSchema() -> userver::yaml_config::Schema {
+    return userver::yaml_config::MergeSchemas<ComponentBase>(R"(
+type: object
+description: Lookup results cache shared by the processes on the host via POSIX shared memory
+additionalProperties: false
+properties:
+    segment-name:
+        type: string
+        description: |
+            Name of the POSIX shared memory segment, e.g. /slugkit-geo-cache.
+            All the processes using the same name must use the same capacity.
+    capacity:
+        type: integer
+        minimum: 1
+        description: Number of cached results, rounded up to a power of two. Each takes 256 bytes.
+        defaultDescription: 65536
+    resolvers:
+        type: array
+        items:
+            type: string
+            description: The name of the geoip resolver component
+        description: |
+            Resolvers to query on a cache miss.
+            If multiple components are provided, the first one that returns a result will be used.
+)");
+}
+
+}  // namespace slugkit::geo::lookup
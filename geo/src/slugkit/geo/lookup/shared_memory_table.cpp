@@ -0,0 +1,334 @@
+#include "shared_memory_table.hpp"
+
+#include <slugkit/geo/ip_address.hpp>
+
+#include <userver/engine/sleep.hpp>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+
+namespace slugkit::geo::lookup {
+
+namespace {
+
+constexpr std::uint64_t kMagic = 0x5347'4543'4143'4845ULL;  // "SGECACHE"
+constexpr std::uint64_t kLayoutVersion = 2;
+constexpr std::uint64_t kLowHalfMask = 0xffff'ffffULL;
+constexpr std::size_t kProbeLength = 8;
+// Writers hold a slot for microseconds, a lock older than this is abandoned
+constexpr std::int64_t kLockLeaseMs = 1000;
+constexpr auto kInitTimeout = std::chrono::seconds{3};
+
+// Slot word indices
+constexpr std::size_t kLockWord = 0;
+constexpr std::size_t kEpochWord = 1;
+constexpr std::size_t kAddressWord = 2;
+constexpr std::size_t kVariantWord = 4;  // The key variant, the contents checksum in the upper half
+
+static_assert(std::atomic_ref<std::uint64_t>::is_always_lock_free, "Shared memory atomics must be address-free");
+
+auto Ref(std::uint64_t& word) -> std::atomic_ref<std::uint64_t> {
+    return std::atomic_ref<std::uint64_t>(word);
+}
+
+auto AddressWords(const SharedMemoryTable::Key& key) -> std::array<std::uint64_t, 2> {
+    std::array<std::uint64_t, 2> words{};
+    std::memcpy(words.data(), key.address.data(), key.address.size());
+    return words;
+}
+
+auto Hash(const SharedMemoryTable::Key& key) -> std::uint64_t {
+    return MixHash(HashAddressBytes(key.address) ^ key.variant);
+}
+
+auto Checksum(std::uint64_t key_hash, std::uint64_t epoch, const SharedMemoryTable::Payload& payload)
+    -> std::uint64_t {
+    auto hash = MixHash(key_hash ^ epoch);
+    for (auto word : payload) {
+        hash = MixHash(hash ^ word);
+    }
+    return hash >> 32;
+}
+
+/// Non-zero wall clock milliseconds, wrapping. Unlike pids and CLOCK_MONOTONIC, they mean the same in every
+/// pid and time namespace. Clock jumps only affect when an abandoned lock is taken over, not the consistency.
+auto LockStamp() -> std::uint64_t {
+    auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()
+    );
+    auto stamp = static_cast<std::uint64_t>(now.count()) & kLowHalfMask;
+    return stamp == 0 ? 1 : stamp;
+}
+
+auto IsLeaseExpired(std::uint64_t stamp, std::uint64_t now) -> bool {
+    // Wrap-around safe, stamps from the future are not expired
+    auto age = static_cast<std::int32_t>(static_cast<std::uint32_t>(now - stamp));
+    return age > kLockLeaseMs;
+}
+
+auto SegmentError(std::string_view action, const std::string& name, int error) -> std::runtime_error {
+    return std::runtime_error(
+        fmt::format("Failed to {} shared memory segment {}: {}", action, name, std::strerror(error))
+    );
+}
+
+/// Only the process that creates the segment sizes it, the others wait for the size. Sizing it by whoever sees
+/// it empty races: a process expecting another capacity could shrink the segment under a mapping, the accesses
+/// beyond the end then fault with SIGBUS.
+auto OpenSegment(const std::string& name, std::size_t size) -> int {
+    auto deadline = std::chrono::steady_clock::now() + kInitTimeout;
+    while (true) {
+        auto fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+        if (fd >= 0) {
+            if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+                auto error = errno;
+                ::close(fd);
+                ::shm_unlink(name.c_str());
+                throw SegmentError("size", name, error);
+            }
+            return fd;
+        }
+        if (errno != EEXIST) {
+            throw SegmentError("create", name, errno);
+        }
+        fd = ::shm_open(name.c_str(), O_RDWR, 0);
+        if (fd < 0) {
+            if (errno != ENOENT) {
+                throw SegmentError("open", name, errno);
+            }
+            continue;  // Removed in between, create it anew
+        }
+        while (true) {
+            struct stat segment_stat {};
+            if (::fstat(fd, &segment_stat) != 0) {
+                auto error = errno;
+                ::close(fd);
+                throw SegmentError("stat", name, error);
+            }
+            if (segment_stat.st_size != 0) {
+                return fd;
+            }
+            if (std::chrono::steady_clock::now() > deadline) {
+                ::close(fd);
+                throw std::runtime_error(fmt::format(
+                    "Timed out waiting for shared memory segment {} to be sized, remove it if its creator crashed",
+                    name
+                ));
+            }
+            userver::engine::SleepFor(std::chrono::milliseconds{1});
+        }
+    }
+}
+
+}  // namespace
+
+struct SharedMemoryTable::Header {
+    std::uint64_t magic;  // Written last by the initialising process
+    std::uint64_t layout_version;
+    std::uint64_t capacity;
+    std::uint64_t slot_words;
+    std::uint64_t epoch;
+    std::uint64_t init_lock;  // Lock stamp of the initialising process
+    std::uint64_t reserved[2];
+};
+
+struct alignas(64) SharedMemoryTable::Slot {
+    std::uint64_t words[kSlotWords];
+};
+
+SharedMemoryTable::SharedMemoryTable(const std::string& name, std::size_t capacity)
+    : capacity_(std::bit_ceil(std::max<std::size_t>(capacity, kProbeLength)))
+    , size_(sizeof(Header) + capacity_ * sizeof(Slot)) {
+    static_assert(sizeof(Header) == 64 && sizeof(Slot) == kSlotWords * sizeof(std::uint64_t));
+
+    auto fd = OpenSegment(name, size_);
+    struct stat segment_stat {};
+    if (::fstat(fd, &segment_stat) != 0) {
+        auto error = errno;
+        ::close(fd);
+        throw SegmentError("stat", name, error);
+    }
+    if (static_cast<std::size_t>(segment_stat.st_size) != size_) {
+        ::close(fd);
+        throw std::runtime_error(fmt::format(
+            "Shared memory segment {} has size {}, expected {} for capacity {}",
+            name,
+            segment_stat.st_size,
+            size_,
+            capacity_
+        ));
+    }
+    memory_ = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    auto error = errno;
+    ::close(fd);
+    if (memory_ == MAP_FAILED) {
+        memory_ = nullptr;
+        throw SegmentError("map", name, error);
+    }
+
+    try {
+        Initialise(name);
+    } catch (...) {
+        ::munmap(memory_, size_);
+        throw;
+    }
+}
+
+SharedMemoryTable::~SharedMemoryTable() {
+    // The segment itself outlives the process for the others and the next start
+    if (memory_) {
+        ::munmap(memory_, size_);
+    }
+}
+
+auto SharedMemoryTable::Find(const Key& key, std::uint64_t epoch, Payload& payload) const -> bool {
+    auto hash = Hash(key);
+    auto address = AddressWords(key);
+    for (std::size_t probe = 0; probe < kProbeLength; ++probe) {
+        auto& words = GetSlot(hash + probe).words;
+        auto lock = Ref(words[kLockWord]).load(std::memory_order_acquire);
+        if ((lock & kLowHalfMask) != 0) {
+            continue;
+        }
+        auto variant = Ref(words[kVariantWord]).load(std::memory_order_relaxed);
+        if (Ref(words[kEpochWord]).load(std::memory_order_relaxed) != epoch ||
+            Ref(words[kAddressWord]).load(std::memory_order_relaxed) != address[0] ||
+            Ref(words[kAddressWord + 1]).load(std::memory_order_relaxed) != address[1] ||
+            (variant & kLowHalfMask) != key.variant) {
+            continue;
+        }
+        for (std::size_t i = 0; i < kPayloadWords; ++i) {
+            payload[i] = Ref(words[kSlotHeaderWords + i]).load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (Ref(words[kLockWord]).load(std::memory_order_relaxed) == lock &&
+            Checksum(hash, epoch, payload) == variant >> 32) {
+            return true;
+        }
+    }
+    return false;
+}
+
+auto SharedMemoryTable::Store(const Key& key, std::uint64_t epoch, const Payload& payload) -> void {
+    auto hash = Hash(key);
+    auto address = AddressWords(key);
+
+    // The same key, then an entry of another epoch (or an empty one), then a pseudo-random victim.
+    // The checks are racy, that only affects which entry gets evicted.
+    std::optional<std::size_t> target;
+    for (std::size_t probe = 0; probe < kProbeLength && !target; ++probe) {
+        auto& words = GetSlot(hash + probe).words;
+        if (Ref(words[kAddressWord]).load(std::memory_order_relaxed) == address[0] &&
+            Ref(words[kAddressWord + 1]).load(std::memory_order_relaxed) == address[1] &&
+            (Ref(words[kVariantWord]).load(std::memory_order_relaxed) & kLowHalfMask) == key.variant) {
+            target = hash + probe;
+        }
+    }
+    for (std::size_t probe = 0; probe < kProbeLength && !target; ++probe) {
+        if (Ref(GetSlot(hash + probe).words[kEpochWord]).load(std::memory_order_relaxed) != epoch) {
+            target = hash + probe;
+        }
+    }
+    auto& slot = GetSlot(target.value_or(hash + (hash >> 32) % kProbeLength));
+
+    std::uint64_t locked = 0;
+    if (!TryLock(slot, locked)) {
+        return;
+    }
+    auto& words = slot.words;
+    Ref(words[kEpochWord]).store(epoch, std::memory_order_relaxed);
+    Ref(words[kAddressWord]).store(address[0], std::memory_order_relaxed);
+    Ref(words[kAddressWord + 1]).store(address[1], std::memory_order_relaxed);
+    Ref(words[kVariantWord]).store(key.variant | (Checksum(hash, epoch, payload) << 32), std::memory_order_relaxed);
+    for (std::size_t i = 0; i < kPayloadWords; ++i) {
+        Ref(words[kSlotHeaderWords + i]).store(payload[i], std::memory_order_relaxed);
+    }
+    // Fails if the lease expired and the slot was taken over, the new owner publishes its own contents
+    auto lock = Ref(words[kLockWord]);
+    auto expected = locked;
+    lock.compare_exchange_strong(expected, ((locked >> 32) + 1) << 32, std::memory_order_release);
+}
+
+auto SharedMemoryTable::GetPublishedEpoch() const -> std::uint64_t {
+    return Ref(GetHeader().epoch).load(std::memory_order_relaxed);
+}
+
+auto SharedMemoryTable::PublishEpoch(std::uint64_t epoch) -> void {
+    Ref(GetHeader().epoch).store(epoch, std::memory_order_relaxed);
+}
+
+auto SharedMemoryTable::Initialise(const std::string& name) -> void {
+    auto& header = GetHeader();
+    auto magic = Ref(header.magic);
+    auto deadline = std::chrono::steady_clock::now() + kInitTimeout;
+    while (magic.load(std::memory_order_acquire) != kMagic) {
+        auto init_lock = Ref(header.init_lock);
+        auto owner = init_lock.load(std::memory_order_relaxed);
+        auto now = LockStamp();
+        // Take over the initialisation if nobody does it or its process is gone
+        if ((owner == 0 || IsLeaseExpired(owner, now)) &&
+            init_lock.compare_exchange_strong(owner, now, std::memory_order_acquire)) {
+            Ref(header.layout_version).store(kLayoutVersion, std::memory_order_relaxed);
+            Ref(header.capacity).store(capacity_, std::memory_order_relaxed);
+            Ref(header.slot_words).store(kSlotWords, std::memory_order_relaxed);
+            magic.store(kMagic, std::memory_order_release);
+            break;
+        }
+        if (std::chrono::steady_clock::now() > deadline) {
+            throw std::runtime_error(fmt::format("Timed out waiting for shared memory segment {} to initialise", name));
+        }
+        userver::engine::SleepFor(std::chrono::milliseconds{1});
+    }
+    if (Ref(header.layout_version).load(std::memory_order_relaxed) != kLayoutVersion ||
+        Ref(header.capacity).load(std::memory_order_relaxed) != capacity_ ||
+        Ref(header.slot_words).load(std::memory_order_relaxed) != kSlotWords) {
+        throw std::runtime_error(fmt::format("Shared memory segment {} has an incompatible layout", name));
+    }
+}
+
+auto SharedMemoryTable::GetHeader() const -> Header& {
+    return *static_cast<Header*>(memory_);
+}
+
+auto SharedMemoryTable::GetSlot(std::size_t index) const -> Slot& {
+    auto* slots = reinterpret_cast<Slot*>(static_cast<std::uint8_t*>(memory_) + sizeof(Header));
+    return slots[index & (capacity_ - 1)];
+}
+
+auto SharedMemoryTable::TryLock(Slot& slot, std::uint64_t& locked) -> bool {
+    auto lock = Ref(slot.words[kLockWord]);
+    auto word = lock.load(std::memory_order_relaxed);
+    auto stamp = word & kLowHalfMask;
+    auto now = LockStamp();
+    auto version = word >> 32;
+    if (stamp != 0) {
+        if (!IsLeaseExpired(stamp, now)) {
+            return false;
+        }
+        // Abandoned mid-write, taken over with a new version so that its writer can't unlock it anymore
+        ++version;
+    }
+    locked = (version << 32) | now;
+    if (!lock.compare_exchange_strong(word, locked, std::memory_order_acquire)) {
+        return false;
+    }
+    // Readers must see the slot locked before any of the new contents
+    std::atomic_thread_fence(std::memory_order_release);
+    return true;
+}
+
+}  // namespace slugkit::geo::lookup
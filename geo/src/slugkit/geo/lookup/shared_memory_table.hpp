@@ -0,0 +1,73 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace slugkit::geo::lookup {
+
+/// @brief Fixed-size open-addressing hash table in a named POSIX shared memory segment.
+/// Shared by all the processes on the host that open the segment with the same name and capacity.
+///
+/// Every slot is guarded by a seqlock word: the upper half is a version, the lower half is a wall clock stamp
+/// (milliseconds, wrapping) while the slot is being written. Readers never lock and treat a slot that is being
+/// written or changed under them as a miss. Writers never wait: a locked slot is skipped, unless its lock lease
+/// has expired, e.g. because the writer crashed mid-write. The lease doesn't depend on pids, so the segment may
+/// be shared across pid namespaces (containers sharing /dev/shm).
+///
+/// Taking over a slot bumps its version, and a writer only unlocks the slot with a CAS from its own locked word,
+/// so a stalled writer can't unlock a slot it has lost. Its late stores may still tear the contents, so every
+/// slot also carries a checksum of its contents, verified by the readers.
+///
+/// Entries are tagged with a data epoch, entries of other epochs are misses and get overwritten first.
+/// Epochs are opaque: they are only compared for equality, never ordered.
+class SharedMemoryTable {
+public:
+    struct Key {
+        std::array<std::uint8_t, 16> address{};
+        std::uint32_t variant{0};
+    };
+
+    static constexpr std::size_t kSlotWords = 32;
+    static constexpr std::size_t kSlotHeaderWords = 5;
+    static constexpr std::size_t kPayloadWords = kSlotWords - kSlotHeaderWords;
+    using Payload = std::array<std::uint64_t, kPayloadWords>;
+
+    /// Blocking. Creates or attaches to the segment, capacity is rounded up to a power of two.
+    /// Only the creating process sizes the segment, the others wait for it to be sized.
+    /// Throws std::runtime_error if the segment can't be mapped or has an incompatible size or layout.
+    SharedMemoryTable(const std::string& name, std::size_t capacity);
+    ~SharedMemoryTable();
+
+    SharedMemoryTable(const SharedMemoryTable&) = delete;
+    auto operator=(const SharedMemoryTable&) -> SharedMemoryTable& = delete;
+
+    [[nodiscard]] auto Find(const Key& key, std::uint64_t epoch, Payload& payload) const -> bool;
+    auto Store(const Key& key, std::uint64_t epoch, const Payload& payload) -> void;
+
+    /// The epoch last published by any process, 0 if none
+    [[nodiscard]] auto GetPublishedEpoch() const -> std::uint64_t;
+    /// The last publisher wins, so that a rollback to older data is published as well
+    auto PublishEpoch(std::uint64_t epoch) -> void;
+
+    [[nodiscard]] auto GetCapacity() const -> std::size_t {
+        return capacity_;
+    }
+
+private:
+    struct Header;
+    struct Slot;
+
+    auto GetHeader() const -> Header&;
+    auto GetSlot(std::size_t index) const -> Slot&;
+    auto Initialise(const std::string& name) -> void;
+    /// @param locked the locked word to unlock the slot with
+    auto TryLock(Slot& slot, std::uint64_t& locked) -> bool;
+
+    std::size_t capacity_;
+    std::size_t size_;
+    void* memory_{nullptr};
+};
+
+}  // namespace slugkit::geo::lookup
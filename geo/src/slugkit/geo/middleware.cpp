@@ -1,4 +1,5 @@
 #include <slugkit/geo/middleware.hpp>
+#include <slugkit/geo/traffic_stats.hpp>
 
 #include <userver/components/component_config.hpp>
 #include <userver/components/component_context.hpp>
@@ -19,6 +20,8 @@ namespace slugkit::geo {
 namespace {
 
 constexpr std::string_view kDefaultIpHeader = "x-real-ip";
+constexpr std::string_view kAcceptLanguageHeader = "Accept-Language";
+constexpr int kMaxQuality = 1000;
 
 using TrustedNetwork = std::variant<userver::utils::ip::NetworkV4, userver::utils::ip::NetworkV6>;
 
@@ -83,6 +86,111 @@ auto ExtractRealIp(const std::string& header_value, const std::vector<TrustedNet
     return trimmed_ips.front();
 }
 
+auto TrimView(std::string_view value) -> std::string_view {
+    constexpr std::string_view kWhitespace = " \t";
+    auto begin = value.find_first_not_of(kWhitespace);
+    if (begin == std::string_view::npos) {
+        return {};
+    }
+    auto end = value.find_last_not_of(kWhitespace);
+    return value.substr(begin, end - begin + 1);
+}
+
+auto ToLowerAscii(char c) -> char {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+auto EqualsIgnoreCase(std::string_view lhs, std::string_view rhs) -> bool {
+    return lhs.size() == rhs.size() &&
+           std::equal(lhs.begin(), lhs.end(), rhs.begin(), [](char l, char r) {
+               return ToLowerAscii(l) == ToLowerAscii(r);
+           });
+}
+
+/// True if `prefix` is `tag` itself or one of its leading subtags (e.g., pt for pt-BR)
+auto IsSubtagPrefix(std::string_view prefix, std::string_view tag) -> bool {
+    return prefix.size() < tag.size() && tag[prefix.size()] == '-' &&
+           EqualsIgnoreCase(prefix, tag.substr(0, prefix.size()));
+}
+
+/// Parses the q parameter of an Accept-Language item into thousandths.
+/// Missing weight means 1, malformed weight makes the item unacceptable.
+auto ParseQuality(std::string_view parameters) -> int {
+    while (!parameters.empty()) {
+        auto semicolon = parameters.find(';');
+        auto parameter = TrimView(parameters.substr(0, semicolon));
+        parameters = semicolon == std::string_view::npos ? std::string_view{} : parameters.substr(semicolon + 1);
+        if (parameter.size() < 2 || ToLowerAscii(parameter[0]) != 'q' || parameter[1] != '=') {
+            continue;
+        }
+        auto value = TrimView(parameter.substr(2));
+        if (value.empty() || (value[0] != '0' && value[0] != '1')) {
+            return 0;
+        }
+        int quality = (value[0] - '0') * kMaxQuality;
+        if (value.size() > 1) {
+            if (value[1] != '.' || value.size() > 5) {
+                return 0;
+            }
+            int scale = kMaxQuality / 10;
+            for (auto c : value.substr(2)) {
+                if (c < '0' || c > '9') {
+                    return 0;
+                }
+                quality += (c - '0') * scale;
+                scale /= 10;
+            }
+        }
+        return quality > kMaxQuality ? 0 : quality;
+    }
+    return kMaxQuality;
+}
+
+/// Matches a single language range against the supported languages.
+/// Exact matches win over prefix matches in either direction (de-AT -> de, pt -> pt-BR).
+auto MatchLanguageRange(std::string_view range, const std::vector<std::string>& languages)
+    -> std::optional<std::size_t> {
+    for (std::size_t i = 0; i < languages.size(); ++i) {
+        if (EqualsIgnoreCase(range, languages[i])) {
+            return i;
+        }
+    }
+    for (std::size_t i = 0; i < languages.size(); ++i) {
+        if (IsSubtagPrefix(languages[i], range) || IsSubtagPrefix(range, languages[i])) {
+            return i;
+        }
+    }
+    return std::nullopt;
+}
+
+/// Picks the supported language with the highest weight from an Accept-Language header value.
+/// Earlier items win ties. Doesn't allocate, the header is scanned in place.
+auto MatchAcceptLanguage(std::string_view header_value, const std::vector<std::string>& languages)
+    -> std::optional<std::size_t> {
+    std::optional<std::size_t> best;
+    int best_quality = 0;
+    while (!header_value.empty() && best_quality < kMaxQuality) {
+        auto comma = header_value.find(',');
+        auto item = header_value.substr(0, comma);
+        header_value = comma == std::string_view::npos ? std::string_view{} : header_value.substr(comma + 1);
+
+        auto semicolon = item.find(';');
+        auto range = TrimView(item.substr(0, semicolon));
+        if (range.empty() || range == "*") {
+            continue;
+        }
+        auto quality = semicolon == std::string_view::npos ? kMaxQuality : ParseQuality(item.substr(semicolon + 1));
+        if (quality <= best_quality) {
+            continue;
+        }
+        if (auto index = MatchLanguageRange(range, languages)) {
+            best = index;
+            best_quality = quality;
+        }
+    }
+    return best;
+}
+
 class GeoMiddleware : public userver::server::middlewares::HttpMiddlewareBase {
 public:
     static constexpr std::string_view kName = "geo-middleware";
@@ -92,27 +200,44 @@ public:
         std::vector<lookup::ComponentBase const*> geoip_resolvers,
         std::string ip_header,
         std::vector<TrustedNetwork> trusted_proxies,
-        bool recursive
+        std::vector<std::string> languages,
+        TrafficStats* traffic_stats,
+        bool recursive,
+        bool log_lookups
     )
         : context_config_(context_config)
         , resolvers_(std::move(geoip_resolvers))
         , ip_header_(std::move(ip_header))
         , trusted_proxies_(std::move(trusted_proxies))
-        , recursive_(recursive) {
+        , languages_(std::move(languages))
+        , traffic_stats_(traffic_stats)
+        , recursive_(recursive)
+        , log_lookups_(log_lookups) {
     }
 
     void HandleRequest(userver::server::http::HttpRequest& request, userver::server::request::RequestContext& context)
         const override {
+        if (std::none_of(resolvers_.begin(), resolvers_.end(), [](auto resolver) { return resolver->IsReady(); })) {
+            // Still loading, pass the request through without geo data
+            Next(request, context);
+            return;
+        }
+
         auto header_value = request.GetHeader(ip_header_);
         auto ip_str = ExtractRealIp(header_value, trusted_proxies_, recursive_);
 
         if (ip_str.empty()) {
-            LOG_WARNING() << "No IP found in header: " << ip_header_;
+            if (log_lookups_) {
+                LOG_WARNING() << "No IP found in header: " << ip_header_;
+            }
             Next(request, context);
             return;
         }
 
-        auto lookup_result = LookupIp(ip_str);
+        auto lookup_result = LookupIp(ip_str, SelectLanguage(request));
+        if (traffic_stats_) {
+            traffic_stats_->Account(ip_str, lookup_result ? &*lookup_result : nullptr);
+        }
         if (lookup_result) {
             SetGeoHeaders(context, *lookup_result);
         }
@@ -120,15 +245,31 @@ public:
     }
 
 private:
-    auto LookupIp(const std::string& ip_str) const -> std::optional<lookup::LookupResult> {
+    /// Empty language means the resolvers' defaults
+    auto SelectLanguage(const userver::server::http::HttpRequest& request) const -> std::string_view {
+        if (languages_.empty()) {
+            return {};
+        }
+        auto index = MatchAcceptLanguage(request.GetHeader(kAcceptLanguageHeader), languages_);
+        return index ? std::string_view{languages_[*index]} : std::string_view{};
+    }
+
+    auto LookupIp(const std::string& ip_str, std::string_view language) const -> std::optional<lookup::LookupResult> {
         for (const auto resolver : resolvers_) {
-            auto lookup_result = resolver->Lookup(ip_str);
+            if (!resolver->IsReady()) {
+                continue;
+            }
+            auto lookup_result = resolver->LookupLocalized(ip_str, language);
             if (lookup_result) {
-                LOG_INFO() << "Resolved IP: " << ip_str << " to " << lookup_result->country_code;
+                if (log_lookups_) {
+                    LOG_INFO() << "Resolved IP: " << ip_str << " to " << lookup_result->country_code;
+                }
                 return lookup_result;
             }
         }
-        LOG_WARNING() << "Failed to resolve IP: " << ip_str;
+        if (log_lookups_) {
+            LOG_WARNING() << "Failed to resolve IP: " << ip_str;
+        }
         return std::nullopt;
     }
     auto SetGeoHeaders(userver::server::request::RequestContext& context, const lookup::LookupResult& lookup_result)
@@ -152,7 +293,10 @@ private:
     std::vector<lookup::ComponentBase const*> resolvers_;
     std::string ip_header_;
     std::vector<TrustedNetwork> trusted_proxies_;
+    std::vector<std::string> languages_;
+    TrafficStats* traffic_stats_;
     bool recursive_;
+    bool log_lookups_;
 };
 
 }  // namespace
@@ -162,14 +306,18 @@ struct GeoMiddlewareFactory::Impl {
     std::vector<lookup::ComponentBase const*> resolvers_;
     std::string ip_header_;
     std::vector<TrustedNetwork> trusted_proxies_;
+    std::vector<std::string> languages_;
+    TrafficStats* traffic_stats_{nullptr};
     bool recursive_;
+    bool log_lookups_;
 
     Impl(const userver::components::ComponentConfig& config, const userver::components::ComponentContext& context)
         : context_config_(context.FindComponent<GeoMiddlewareConfig>(
               config["config-name"].As<std::string>("geoip-middleware-config")
           ))
         , ip_header_(config["ip-header"].As<std::string>(kDefaultIpHeader))
-        , recursive_(config["recursive"].As<bool>(false)) {
+        , recursive_(config["recursive"].As<bool>(false))
+        , log_lookups_(config["log-lookups"].As<bool>(true)) {
         auto resolver_names = config["resolvers"].As<std::vector<std::string>>();
         for (const auto& resolver_name : resolver_names) {
             resolvers_.push_back(&context.FindComponent<lookup::ComponentBase>(resolver_name));
@@ -178,6 +326,22 @@ struct GeoMiddlewareFactory::Impl {
             throw std::runtime_error("No geoip resolvers provided");
         }
 
+        auto traffic_stats_name = config["traffic-stats"].As<std::optional<std::string>>();
+        if (traffic_stats_name) {
+            traffic_stats_ = &context.FindComponent<TrafficStats>(*traffic_stats_name);
+        }
+
+        // Union of the resolvers' languages, matched against Accept-Language
+        if (config["accept-language"].As<bool>(true)) {
+            for (const auto resolver : resolvers_) {
+                for (auto& language : resolver->GetLanguages()) {
+                    if (std::find(languages_.begin(), languages_.end(), language) == languages_.end()) {
+                        languages_.push_back(std::move(language));
+                    }
+                }
+            }
+        }
+
         // Parse trusted proxy networks
         auto trusted_proxy_cidrs = config["trusted-proxies"].As<std::vector<std::string>>({});
         for (const auto& cidr : trusted_proxy_cidrs) {
@@ -213,7 +377,14 @@ auto GeoMiddlewareFactory::Create(
     [[maybe_unused]] userver::yaml_config::YamlConfig middleware_config
 ) const -> std::unique_ptr<userver::server::middlewares::HttpMiddlewareBase> {
     return std::make_unique<GeoMiddleware>(
-        impl_->context_config_, impl_->resolvers_, impl_->ip_header_, impl_->trusted_proxies_, impl_->recursive_
+        impl_->context_config_,
+        impl_->resolvers_,
+        impl_->ip_header_,
+        impl_->trusted_proxies_,
+        impl_->languages_,
+        impl_->traffic_stats_,
+        impl_->recursive_,
+        impl_->log_lookups_
     );
 }
 
@@ -255,6 +426,21 @@ properties:
             When true, walks backwards through X-Forwarded-For header, skipping trusted proxies.
             When false, uses the first IP from the header.
         defaultDescription: false
+    accept-language:
+        type: boolean
+        description: |
+            Select the language of the names from the Accept-Language header.
+            Only the languages supported by the resolvers are considered, otherwise the resolvers' defaults are used.
+        defaultDescription: true
+    traffic-stats:
+        type: string
+        description: |
+            Name of the geoip-traffic-stats component to account every request in.
+            Together with log-lookups disabled, replaces the per-request logs as the source of traffic distribution.
+    log-lookups:
+        type: boolean
+        description: Log every resolved and unresolved IP address and every request without one
+        defaultDescription: true
 )");
 }
 
@@ -0,0 +1,258 @@
+#include <slugkit/geo/prefix_sketch.hpp>
+
+#include <arpa/inet.h>
+
+#include <algorithm>
+#include <bit>
+#include <limits>
+#include <mutex>
+
+namespace slugkit::geo {
+
+namespace {
+
+constexpr std::size_t kIpv4PrefixBytes = kIpv4MappedPrefixSize + 3;  // /24
+constexpr std::size_t kIpv6PrefixBytes = 6;                          // /48
+
+// Stale candidates refreshed from the sketch per eviction, bounds the time the table is locked for
+constexpr std::size_t kMaxRefreshes = 8;
+
+/// Non-zero, zero marks a free slot of the members set
+auto ToMember(std::size_t hash) -> std::uint64_t {
+    return static_cast<std::uint64_t>(hash) | 1;
+}
+
+auto RowIndex(std::size_t hash, std::size_t row, std::size_t width) -> std::size_t {
+    constexpr std::uint64_t kGolden = 0x9e3779b97f4a7c15ULL;
+    return static_cast<std::size_t>(MixHash(hash + row * kGolden)) & (width - 1);
+}
+
+}  // namespace
+
+auto NetworkPrefix::FromAddress(const IpAddress& address) -> NetworkPrefix {
+    NetworkPrefix prefix;
+    auto size = address.is_v4 ? kIpv4PrefixBytes : kIpv6PrefixBytes;
+    std::copy_n(address.bytes.begin(), size, prefix.bytes.begin());
+    return prefix;
+}
+
+auto NetworkPrefix::IsV4() const -> bool {
+    return IsIpv4Mapped(bytes);
+}
+
+auto NetworkPrefix::ToAddress() const -> IpAddress {
+    return IpAddress{bytes, IsV4()};
+}
+
+auto NetworkPrefix::ToString() const -> std::string {
+    char buffer[INET6_ADDRSTRLEN] = {};
+    if (IsV4()) {
+        ::inet_ntop(AF_INET, bytes.data() + kIpv4MappedPrefixSize, buffer, sizeof(buffer));
+        return std::string{buffer} + "/24";
+    }
+    ::inet_ntop(AF_INET6, bytes.data(), buffer, sizeof(buffer));
+    return std::string{buffer} + "/48";
+}
+
+auto NetworkPrefixHash::operator()(const NetworkPrefix& prefix) const noexcept -> std::size_t {
+    return static_cast<std::size_t>(HashAddressBytes(prefix.bytes));
+}
+
+PrefixSketch::PrefixSketch(std::size_t capacity)
+    : capacity_(capacity)
+    , members_(std::bit_ceil(std::max<std::size_t>(capacity * 2, 2))) {
+    candidates_.reserve(capacity_);
+}
+
+auto PrefixSketch::Record(const NetworkPrefix& prefix) -> void {
+    auto hash = NetworkPrefixHash{}(prefix);
+    auto estimate = std::numeric_limits<std::uint32_t>::max();
+    for (std::size_t row = 0; row < kDepth; ++row) {
+        auto& counter = counters_[row][RowIndex(hash, row, kWidth)];
+        estimate = std::min(estimate, counter.fetch_add(1, std::memory_order_relaxed) + 1);
+    }
+    if (capacity_ == 0 || estimate <= threshold_.load(std::memory_order_relaxed) || IsCandidate(hash)) {
+        return;
+    }
+    std::unique_lock lock(mutex_, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        return;
+    }
+    Insert(prefix, hash, estimate);
+}
+
+auto PrefixSketch::GetTop() const -> std::vector<PrefixCount> {
+    std::vector<PrefixCount> top;
+    {
+        std::lock_guard lock(mutex_);
+        top.reserve(by_count_.size());
+        for (const auto& [count, prefix] : by_count_) {
+            top.push_back({prefix, std::max(count, Estimate(NetworkPrefixHash{}(prefix)))});
+        }
+    }
+    std::sort(top.begin(), top.end(), [](const auto& lhs, const auto& rhs) { return lhs.count > rhs.count; });
+    return top;
+}
+
+auto PrefixSketch::Merge(const std::vector<PrefixCount>& prefixes) -> void {
+    std::lock_guard lock(mutex_);
+    for (const auto& [prefix, count] : prefixes) {
+        auto hash = NetworkPrefixHash{}(prefix);
+        for (std::size_t row = 0; row < kDepth; ++row) {
+            counters_[row][RowIndex(hash, row, kWidth)].fetch_add(count, std::memory_order_relaxed);
+        }
+        Insert(prefix, hash, Estimate(hash));
+    }
+}
+
+auto PrefixSketch::Decay() -> void {
+    for (auto& row : counters_) {
+        for (auto& counter : row) {
+            // Racing increments may be lost, that's fine for an estimate
+            counter.store(counter.load(std::memory_order_relaxed) / 2, std::memory_order_relaxed);
+        }
+    }
+    std::lock_guard lock(mutex_);
+    // Halving keeps the order, so the nodes are moved to the end of the new map in constant time each
+    ByCount decayed;
+    while (!by_count_.empty()) {
+        auto node = by_count_.extract(by_count_.begin());
+        node.key() /= 2;
+        candidates_[node.mapped()] = decayed.insert(decayed.end(), std::move(node));
+    }
+    by_count_.swap(decayed);
+    UpdateThreshold();
+}
+
+auto PrefixSketch::Estimate(std::size_t hash) const -> std::uint32_t {
+    auto estimate = std::numeric_limits<std::uint32_t>::max();
+    for (std::size_t row = 0; row < kDepth; ++row) {
+        estimate = std::min(estimate, counters_[row][RowIndex(hash, row, kWidth)].load(std::memory_order_relaxed));
+    }
+    return estimate;
+}
+
+/// Must be called with the mutex locked
+auto PrefixSketch::Insert(const NetworkPrefix& prefix, std::size_t hash, std::uint32_t estimate) -> void {
+    if (capacity_ == 0) {
+        return;
+    }
+    if (auto it = candidates_.find(prefix); it != candidates_.end()) {
+        Raise(it->second, estimate);
+        return;
+    }
+    if (candidates_.size() >= capacity_ && !EvictBelow(estimate)) {
+        return;
+    }
+    candidates_.emplace(prefix, by_count_.emplace(estimate, prefix));
+    AddMember(hash);
+    UpdateThreshold();
+}
+
+/// Must be called with the mutex locked.
+/// Evicts the least frequent candidate if it is less frequent than the estimate. Stored counts lag behind
+/// the sketch, so the minimal ones are refreshed first, a few per call.
+auto PrefixSketch::EvictBelow(std::uint32_t estimate) -> bool {
+    for (std::size_t refresh = 0; refresh < kMaxRefreshes; ++refresh) {
+        auto min_it = by_count_.begin();
+        auto current = Estimate(NetworkPrefixHash{}(min_it->second));
+        if (current <= min_it->first) {
+            break;
+        }
+        Raise(candidates_.find(min_it->second)->second, current);
+    }
+    auto min_it = by_count_.begin();
+    if (estimate <= min_it->first) {
+        UpdateThreshold();
+        return false;
+    }
+    RemoveMember(NetworkPrefixHash{}(min_it->second));
+    candidates_.erase(min_it->second);
+    by_count_.erase(min_it);
+    return true;
+}
+
+/// Must be called with the mutex locked
+auto PrefixSketch::Raise(ByCount::iterator& entry, std::uint32_t count) -> void {
+    if (count <= entry->first) {
+        return;
+    }
+    auto node = by_count_.extract(entry);
+    node.key() = count;
+    entry = by_count_.insert(std::move(node));
+}
+
+/// Must be called with the mutex locked
+auto PrefixSketch::UpdateThreshold() -> void {
+    std::uint32_t threshold = 0;
+    if (candidates_.size() >= capacity_ && !by_count_.empty()) {
+        threshold = by_count_.begin()->first;
+    }
+    threshold_.store(threshold, std::memory_order_relaxed);
+}
+
+auto PrefixSketch::GetMemberHome(std::uint64_t member) const -> std::size_t {
+    // The low bit is always set, the high ones are as good as any
+    return static_cast<std::size_t>(member >> 32) & (members_.size() - 1);
+}
+
+auto PrefixSketch::IsCandidate(std::size_t hash) const -> bool {
+    auto member = ToMember(hash);
+    auto mask = members_.size() - 1;
+    auto home = GetMemberHome(member);
+    for (std::size_t probe = 0; probe < members_.size(); ++probe) {
+        auto current = members_[(home + probe) & mask].load(std::memory_order_relaxed);
+        if (current == member) {
+            return true;
+        }
+        if (current == 0) {
+            return false;
+        }
+    }
+    return false;
+}
+
+/// Must be called with the mutex locked. The set is at most half full, there is always a free slot.
+auto PrefixSketch::AddMember(std::size_t hash) -> void {
+    auto member = ToMember(hash);
+    auto mask = members_.size() - 1;
+    for (auto index = GetMemberHome(member);; index = (index + 1) & mask) {
+        auto current = members_[index].load(std::memory_order_relaxed);
+        if (current == member) {
+            return;
+        }
+        if (current == 0) {
+            members_[index].store(member, std::memory_order_relaxed);
+            return;
+        }
+    }
+}
+
+/// Must be called with the mutex locked. Backward shift deletion, no tombstones to clean up.
+auto PrefixSketch::RemoveMember(std::size_t hash) -> void {
+    auto member = ToMember(hash);
+    auto mask = members_.size() - 1;
+    auto index = GetMemberHome(member);
+    while (members_[index].load(std::memory_order_relaxed) != member) {
+        if (members_[index].load(std::memory_order_relaxed) == 0) {
+            return;
+        }
+        index = (index + 1) & mask;
+    }
+    for (auto next = (index + 1) & mask;; next = (next + 1) & mask) {
+        auto current = members_[next].load(std::memory_order_relaxed);
+        if (current == 0) {
+            break;
+        }
+        // Members whose home is cyclically in (index, next] stay where they are
+        auto home = GetMemberHome(current);
+        auto stays = index <= next ? (index < home && home <= next) : (index < home || home <= next);
+        if (!stays) {
+            members_[index].store(current, std::memory_order_relaxed);
+            index = next;
+        }
+    }
+    members_[index].store(0, std::memory_order_relaxed);
+}
+
+}  // namespace slugkit::geo
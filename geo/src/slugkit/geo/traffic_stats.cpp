@@ -0,0 +1,381 @@
+#include <slugkit/geo/traffic_stats.hpp>
+
+#include <slugkit/geo/ip_address.hpp>
+#include <slugkit/geo/lookup/lookup_component_base.hpp>
+
+#include <userver/components/component_config.hpp>
+#include <userver/components/component_context.hpp>
+#include <userver/components/statistics_storage.hpp>
+#include <userver/utils/statistics/storage.hpp>
+#include <userver/utils/periodic_task.hpp>
+#include <userver/utils/statistics/writer.hpp>
+#include <userver/yaml_config/merge_schemas.hpp>
+#include <userver/yaml_config/yaml_config.hpp>
+
+#include <sched.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+
+namespace slugkit::geo {
+
+namespace {
+
+constexpr std::size_t kAlphabetSize = 26;
+// Two-letter ISO codes, plus one slot for resolved requests without a valid code
+constexpr std::size_t kCountrySlots = kAlphabetSize * kAlphabetSize + 1;
+constexpr std::size_t kNoCountry = kCountrySlots - 1;
+constexpr std::size_t kAsnProbeLength = 16;
+constexpr std::size_t kDefaultAsnCapacity = 1024;
+constexpr std::size_t kDefaultAsnLimit = 50;
+constexpr std::size_t kDefaultPrefixCapacity = 100;
+constexpr std::chrono::milliseconds kDefaultPrefixDecayInterval{60'000};
+
+// HyperLogLog with 2^10 registers, ~3% standard error
+constexpr unsigned kHllPrecision = 10;
+constexpr std::size_t kHllRegisters = 1UL << kHllPrecision;
+
+auto CountryIndex(std::string_view country_code) -> std::size_t {
+    if (country_code.size() != 2 || country_code[0] < 'A' || country_code[0] > 'Z' || country_code[1] < 'A' ||
+        country_code[1] > 'Z') {
+        return kNoCountry;
+    }
+    return static_cast<std::size_t>(country_code[0] - 'A') * kAlphabetSize +
+           static_cast<std::size_t>(country_code[1] - 'A');
+}
+
+auto CountryCode(std::size_t index) -> std::string {
+    if (index == kNoCountry) {
+        return "--";
+    }
+    return {static_cast<char>('A' + index / kAlphabetSize), static_cast<char>('A' + index % kAlphabetSize)};
+}
+
+class HyperLogLog {
+public:
+    auto Add(std::uint64_t hash) -> void {
+        auto index = hash >> (64 - kHllPrecision);
+        // The guard bit bounds the rank if the remaining bits are all zero
+        auto rest = (hash << kHllPrecision) | (1ULL << (kHllPrecision - 1));
+        auto rank = static_cast<std::uint8_t>(std::countl_zero(rest) + 1);
+        auto& register_value = registers_[index];
+        auto current = register_value.load(std::memory_order_relaxed);
+        while (rank > current &&
+               !register_value.compare_exchange_weak(current, rank, std::memory_order_relaxed)) {
+        }
+    }
+
+    [[nodiscard]] auto Estimate() const -> std::uint64_t {
+        constexpr double kRegisters = kHllRegisters;
+        const double alpha = 0.7213 / (1.0 + 1.079 / kRegisters);
+        double sum = 0;
+        std::size_t zeros = 0;
+        for (const auto& register_value : registers_) {
+            auto rank = register_value.load(std::memory_order_relaxed);
+            sum += std::ldexp(1.0, -rank);
+            zeros += rank == 0 ? 1 : 0;
+        }
+        auto estimate = alpha * kRegisters * kRegisters / sum;
+        // Linear counting is more accurate for small cardinalities
+        if (estimate <= 2.5 * kRegisters && zeros != 0) {
+            estimate = kRegisters * std::log(kRegisters / static_cast<double>(zeros));
+        }
+        return static_cast<std::uint64_t>(std::llround(estimate));
+    }
+
+private:
+    std::array<std::atomic<std::uint8_t>, kHllRegisters> registers_{};
+};
+
+struct AsnCounter {
+    std::atomic<std::uint32_t> asn{0};
+    std::atomic<std::uint64_t> requests{0};
+};
+
+/// Counters of a single CPU, cache line aligned so that the shards don't share lines
+struct alignas(64) Shard {
+    Shard(std::size_t asn_capacity, std::size_t prefix_capacity)
+        : asns(std::make_unique<AsnCounter[]>(asn_capacity))
+        , prefixes(std::make_unique<PrefixSketch>(prefix_capacity)) {
+    }
+
+    std::atomic<std::uint64_t> requests{0};
+    std::atomic<std::uint64_t> unresolved{0};
+    std::atomic<std::uint64_t> asn_overflow{0};
+    std::array<std::atomic<std::uint64_t>, kCountrySlots> countries{};
+    std::unique_ptr<AsnCounter[]> asns;
+    std::unique_ptr<PrefixSketch> prefixes;
+};
+
+}  // namespace
+
+struct TrafficStats::Impl {
+    std::size_t asn_capacity_;
+    std::size_t asn_limit_;
+    // Resolves the ASNs of the results that don't have them, e.g. of a City database
+    lookup::ComponentBase const* asn_resolver_{nullptr};
+    std::vector<std::unique_ptr<Shard>> shards_;
+    // Sketches are allocated on the first request from the country, most of them never are
+    std::vector<std::atomic<HyperLogLog*>> unique_ips_;
+    std::size_t prefix_capacity_;
+    // Prefix counters are halved periodically, so they reflect the recent traffic and never wrap around
+    userver::utils::PeriodicTask prefix_decay_;
+    userver::utils::statistics::Entry statistics_holder_;
+
+    Impl(const userver::components::ComponentConfig& config, const userver::components::ComponentContext& context)
+        : asn_capacity_(std::bit_ceil(config["asn-capacity"].As<std::size_t>(kDefaultAsnCapacity)))
+        , asn_limit_(config["asn-limit"].As<std::size_t>(kDefaultAsnLimit))
+        , unique_ips_(kCountrySlots)
+        , prefix_capacity_(config["prefix-capacity"].As<std::size_t>(kDefaultPrefixCapacity)) {
+        if (auto asn_resolver = config["asn-resolver"].As<std::optional<std::string>>()) {
+            asn_resolver_ = &context.FindComponent<lookup::ComponentBase>(*asn_resolver);
+        }
+        auto default_shards = std::max<std::size_t>(1, std::thread::hardware_concurrency());
+        auto shard_count = config["shards"].As<std::size_t>(default_shards);
+        shards_.reserve(shard_count);
+        for (std::size_t i = 0; i < shard_count; ++i) {
+            shards_.push_back(std::make_unique<Shard>(asn_capacity_, prefix_capacity_));
+        }
+        userver::utils::PeriodicTask::Settings decay_settings{
+            config["prefix-decay-interval"].As<std::chrono::milliseconds>(kDefaultPrefixDecayInterval)
+        };
+        prefix_decay_.Start("geo-traffic-prefix-decay", decay_settings, [this] {
+            for (auto& shard : shards_) {
+                shard->prefixes->Decay();
+            }
+        });
+
+        auto& storage = context.FindComponent<userver::components::StatisticsStorage>().GetStorage();
+        statistics_holder_ = storage.RegisterWriter("geo.traffic", [this](userver::utils::statistics::Writer& writer) {
+            WriteStatistics(writer);
+        });
+    }
+
+    ~Impl() {
+        prefix_decay_.Stop();
+        statistics_holder_.Unregister();
+        for (auto& unique_ips : unique_ips_) {
+            delete unique_ips.load(std::memory_order_acquire);
+        }
+    }
+
+    auto GetShard() -> Shard& {
+        auto cpu = ::sched_getcpu();
+        return *shards_[cpu < 0 ? 0 : static_cast<std::size_t>(cpu) % shards_.size()];
+    }
+
+    auto GetUniqueIps(std::size_t country) -> HyperLogLog& {
+        auto& slot = unique_ips_[country];
+        auto* sketch = slot.load(std::memory_order_acquire);
+        if (sketch) {
+            return *sketch;
+        }
+        auto created = std::make_unique<HyperLogLog>();
+        if (slot.compare_exchange_strong(sketch, created.get(), std::memory_order_acq_rel)) {
+            return *created.release();
+        }
+        return *sketch;
+    }
+
+    auto CountAsn(Shard& shard, std::uint32_t asn) -> void {
+        auto start = static_cast<std::size_t>(MixHash(asn));
+        for (std::size_t probe = 0; probe < kAsnProbeLength; ++probe) {
+            auto& counter = shard.asns[(start + probe) & (asn_capacity_ - 1)];
+            auto current = counter.asn.load(std::memory_order_relaxed);
+            if (current == 0 && counter.asn.compare_exchange_strong(current, asn, std::memory_order_relaxed)) {
+                current = asn;
+            }
+            if (current == asn) {
+                counter.requests.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        }
+        shard.asn_overflow.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    auto Account(const std::string& ip, const lookup::LookupResult* result) -> void {
+        auto address = ParseIpAddress(ip);
+        if (!address) {
+            return;
+        }
+        auto& shard = GetShard();
+        shard.requests.fetch_add(1, std::memory_order_relaxed);
+        shard.prefixes->Record(NetworkPrefix::FromAddress(*address));
+        if (result) {
+            auto country = CountryIndex(result->country_code);
+            shard.countries[country].fetch_add(1, std::memory_order_relaxed);
+            GetUniqueIps(country).Add(HashAddressBytes(address->bytes));
+        } else {
+            shard.unresolved.fetch_add(1, std::memory_order_relaxed);
+        }
+        auto asn = result ? result->asn : std::nullopt;
+        if (!asn && asn_resolver_ && asn_resolver_->IsReady()) {
+            if (auto asn_result = asn_resolver_->Lookup(ip)) {
+                asn = asn_result->asn;
+            }
+        }
+        if (asn && *asn != 0) {
+            CountAsn(shard, *asn);
+        }
+    }
+
+    auto GetSnapshot() const -> TrafficSnapshot {
+        auto snapshot = CollectCounters();
+        snapshot.prefixes = CollectPrefixes();
+        return snapshot;
+    }
+
+    /// Everything but the prefixes, which are only reported by the handler
+    auto CollectCounters() const -> TrafficSnapshot {
+        TrafficSnapshot snapshot;
+        std::array<std::uint64_t, kCountrySlots> countries{};
+        std::unordered_map<std::uint32_t, std::uint64_t> asns;
+        for (const auto& shard : shards_) {
+            snapshot.requests += shard->requests.load(std::memory_order_relaxed);
+            snapshot.unresolved += shard->unresolved.load(std::memory_order_relaxed);
+            snapshot.asn_overflow += shard->asn_overflow.load(std::memory_order_relaxed);
+            for (std::size_t i = 0; i < kCountrySlots; ++i) {
+                countries[i] += shard->countries[i].load(std::memory_order_relaxed);
+            }
+            for (std::size_t i = 0; i < asn_capacity_; ++i) {
+                auto asn = shard->asns[i].asn.load(std::memory_order_relaxed);
+                if (asn != 0) {
+                    asns[asn] += shard->asns[i].requests.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        for (std::size_t i = 0; i < kCountrySlots; ++i) {
+            if (countries[i] == 0) {
+                continue;
+            }
+            const auto* unique_ips = unique_ips_[i].load(std::memory_order_acquire);
+            snapshot.countries.push_back({CountryCode(i), countries[i], unique_ips ? unique_ips->Estimate() : 0});
+        }
+        std::sort(snapshot.countries.begin(), snapshot.countries.end(), [](const auto& lhs, const auto& rhs) {
+            return lhs.requests > rhs.requests;
+        });
+
+        snapshot.asns.reserve(asns.size());
+        for (const auto& [asn, requests] : asns) {
+            snapshot.asns.push_back({asn, requests});
+        }
+        auto asn_count = std::min(asn_limit_, snapshot.asns.size());
+        std::partial_sort(
+            snapshot.asns.begin(),
+            snapshot.asns.begin() + static_cast<std::ptrdiff_t>(asn_count),
+            snapshot.asns.end(),
+            [](const auto& lhs, const auto& rhs) { return lhs.requests > rhs.requests; }
+        );
+        snapshot.asns.resize(asn_count);
+        return snapshot;
+    }
+
+    auto CollectPrefixes() const -> std::vector<PrefixCount> {
+        std::unordered_map<NetworkPrefix, std::uint64_t, NetworkPrefixHash> prefixes;
+        for (const auto& shard : shards_) {
+            for (const auto& [prefix, count] : shard->prefixes->GetTop()) {
+                prefixes[prefix] += count;
+            }
+        }
+        std::vector<PrefixCount> top;
+        top.reserve(prefixes.size());
+        for (const auto& [prefix, count] : prefixes) {
+            auto clamped = std::min<std::uint64_t>(count, std::numeric_limits<std::uint32_t>::max());
+            top.push_back({prefix, static_cast<std::uint32_t>(clamped)});
+        }
+        auto prefix_count = std::min(prefix_capacity_, top.size());
+        std::partial_sort(
+            top.begin(),
+            top.begin() + static_cast<std::ptrdiff_t>(prefix_count),
+            top.end(),
+            [](const auto& lhs, const auto& rhs) { return lhs.count > rhs.count; }
+        );
+        top.resize(prefix_count);
+        return top;
+    }
+
+    auto WriteStatistics(userver::utils::statistics::Writer& writer) const -> void {
+        using userver::utils::statistics::LabelView;
+        auto snapshot = CollectCounters();
+        writer["requests"] = snapshot.requests;
+        writer["unresolved"] = snapshot.unresolved;
+        writer["asn"]["overflow"] = snapshot.asn_overflow;
+        for (const auto& country : snapshot.countries) {
+            LabelView label{"country", country.country_code};
+            writer["country"]["requests"].ValueWithLabels(country.requests, label);
+            writer["country"]["unique-ips"].ValueWithLabels(country.unique_ips, label);
+        }
+        for (const auto& asn : snapshot.asns) {
+            writer["asn"]["requests"].ValueWithLabels(asn.requests, LabelView{"asn", std::to_string(asn.asn)});
+        }
+    }
+};
+
+TrafficStats::TrafficStats(
+    const userver::components::ComponentConfig& config,
+    const userver::components::ComponentContext& context
+)
+    : userver::components::ComponentBase(config, context)
+    , impl_{config, context} {
+}
+
+TrafficStats::~TrafficStats() = default;
+
+auto TrafficStats::Account(const std::string& ip, const lookup::LookupResult* result) -> void {
+    impl_->Account(ip, result);
+}
+
+auto TrafficStats::GetSnapshot() const -> TrafficSnapshot {
+    return impl_->GetSnapshot();
+}
+
+auto TrafficStats::GetStaticConfigSchema() -> userver::yaml_config::Schema {
+    return userver::yaml_config::MergeSchemas<userver::components::ComponentBase>(R"(
+type: object
+description: Aggregated geo traffic statistics
+additionalProperties: false
+properties:
+    asn-resolver:
+        type: string
+        description: |
+            Name of the geoip resolver component to look up the ASNs with (e.g. a maxmind-db-lookup over
+            GeoLite2-ASN.mmdb), for the results that don't have them. Without it, only the ASNs from the results
+            are counted.
+    shards:
+        type: integer
+        minimum: 1
+        description: Number of counter shards, requests are counted in the shard of the current CPU
+        defaultDescription: number of CPUs
+    asn-capacity:
+        type: integer
+        minimum: 1
+        description: Number of distinct ASNs counted per shard, rounded up to a power of two
+        defaultDescription: 1024
+    asn-limit:
+        type: integer
+        minimum: 0
+        description: Number of the top ASNs to report
+        defaultDescription: 50
+    prefix-capacity:
+        type: integer
+        minimum: 0
+        description: Number of the heaviest /24 (IPv4) and /48 (IPv6) prefixes to track per shard and to report
+        defaultDescription: 100
+    prefix-decay-interval:
+        type: string
+        description: Interval between halvings of the prefix counters, they count about two intervals of traffic
+        defaultDescription: 1m
+)");
+}
+
+}  // namespace slugkit::geo